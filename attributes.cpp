@@ -0,0 +1,327 @@
+#include "attributes.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+
+using namespace std;
+
+namespace {
+
+const int64_t ExactSizes = int64_t(1) << 31;
+const int64_t Day = 86400;
+
+// A type: word and the extensions it stands for
+struct KindGroup {
+    const char* names;
+    const char* extensions;
+};
+const KindGroup KindGroups[] = {
+    { "picture pictures image images photo photos",
+      "jpg jpeg png gif bmp tif tiff webp heic heif svg ico raw cr2 nef psd" },
+    { "video videos movie movies", "mp4 mkv avi mov wmv webm m4v flv mpg mpeg 3gp" },
+    { "audio music sound", "mp3 wav flac aac ogg m4a wma opus aiff mid" },
+    { "document documents doc docs", "pdf doc docx xls xlsx ppt pptx txt rtf odt ods odp md csv epub" },
+    { "archive archives", "zip rar 7z tar gz bz2 xz tgz iso cab zst" },
+    { "program programs executable executables", "exe msi bat cmd ps1 com sh appimage" },
+    { "shortcut shortcuts", "lnk url" },
+};
+
+string folded(string_view text) {
+    string out(text);
+    for (char& c : out) {
+        if (c >= 'A' && c <= 'Z') c = char(c + ('a' - 'A'));
+    }
+    return out;
+}
+
+// Calls fn for every item of a list separated by commas, semicolons or spaces
+template <typename Fn>
+void forEachWord(string_view text, Fn fn) {
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t end = min(text.find_first_of(",; ", pos), text.size());
+        fn(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+}
+
+enum Comparison { Equal, Less, LessEqual, Greater, GreaterEqual, Range };
+
+// Takes the operator off value, a range leaves its second operand in upper
+Comparison comparisonOf(string_view& value, string_view& upper) {
+    size_t dots = value.find("..");
+    if (dots != string_view::npos) {
+        upper = value.substr(dots + 2);
+        value = value.substr(0, dots);
+        return Range;
+    }
+    const pair<string_view, Comparison> Operators[] = {
+        { ">=", GreaterEqual }, { "<=", LessEqual }, { ">", Greater }, { "<", Less }, { "=", Equal }
+    };
+    for (const auto& [symbol, comparison] : Operators) {
+        if (value.substr(0, symbol.size()) == symbol) {
+            value.remove_prefix(symbol.size());
+            return comparison;
+        }
+    }
+    return Equal;
+}
+
+// A number and the lower-cased unit after it, false when there is no number
+bool numberWithUnit(string_view text, double& number, string& unit) {
+    string copy(text);
+    char* end = nullptr;
+    number = strtod(copy.c_str(), &end);
+    if (end == copy.c_str() || number < 0) return false;
+    unit = folded(end);
+    return true;
+}
+
+bool bytesOf(string_view text, int64_t& bytes) {
+    double number;
+    string unit;
+    if (!numberWithUnit(text, number, unit)) return false;
+
+    double multiplier;
+    if (unit.empty() || unit == "b") multiplier = 1;
+    else if (unit == "k" || unit == "kb" || unit == "kib") multiplier = double(1 << 10);
+    else if (unit == "m" || unit == "mb" || unit == "mib") multiplier = double(1 << 20);
+    else if (unit == "g" || unit == "gb" || unit == "gib") multiplier = double(1 << 30);
+    else if (unit == "t" || unit == "tb" || unit == "tib") multiplier = double(int64_t(1) << 40);
+    else return false;
+
+    double value = number * multiplier + 0.5;
+    if (value > 9e18) return false;
+    bytes = int64_t(value);
+    return true;
+}
+
+// Local midnight of a YYYY-MM-DD date
+bool dayStart(string_view text, int64_t& seconds, int64_t& nextDay) {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') return false;
+    for (size_t i : { 0, 1, 2, 3, 5, 6, 8, 9 }) {
+        if (text[i] < '0' || text[i] > '9') return false;
+    }
+    auto digits = [&](size_t pos, size_t count) { return atoi(string(text.substr(pos, count)).c_str()); };
+
+    tm day = {};
+    day.tm_year = digits(0, 4) - 1900;
+    day.tm_mon = digits(5, 2) - 1;
+    day.tm_mday = digits(8, 2);
+    day.tm_isdst = -1;
+    tm next = day;
+    ++next.tm_mday; // mktime rolls it over, and a DST day is not 24 hours
+    seconds = int64_t(mktime(&day));
+    nextDay = int64_t(mktime(&next));
+    return seconds != -1 && nextDay != -1;
+}
+
+// [from, to] of a date, or the single instant an age points at
+bool timeSpan(string_view text, uint32_t now, int64_t& from, int64_t& to, bool& isAge) {
+    int64_t nextDay;
+    if (dayStart(text, from, nextDay)) {
+        to = nextDay - 1;
+        isAge = false;
+        return true;
+    }
+
+    double number;
+    string unit;
+    if (!numberWithUnit(text, number, unit)) return false;
+
+    double length;
+    if (unit == "h") length = 3600;
+    else if (unit == "d") length = Day;
+    else if (unit == "w") length = 7 * Day;
+    else if (unit == "m") length = 30 * Day;
+    else if (unit == "y") length = 365 * Day;
+    else return false;
+
+    from = to = int64_t(now) - int64_t(number * length);
+    isAge = true;
+    return true;
+}
+
+}
+
+uint32_t Attributes::packSize(int64_t bytes) {
+    if (bytes <= 0) return 0;
+    if (bytes < ExactSizes) return uint32_t(bytes);
+    int64_t packed = ExactSizes + (bytes >> 10) - (ExactSizes >> 10);
+    return uint32_t(min<int64_t>(packed, UnknownSize - 1));
+}
+
+int64_t Attributes::unpackSize(uint32_t packed) {
+    if (packed < ExactSizes) return packed;
+    if (packed == UnknownSize) return 0;
+    return (int64_t(packed) - ExactSizes + (ExactSizes >> 10)) << 10;
+}
+
+uint32_t Attributes::unixTime(int64_t ticks) {
+    if (ticks == 0) return 0;
+    // Anything from before 1970 still counts as known
+    int64_t seconds = (ticks - DirStamp::UnixEpoch) / DirStamp::TicksPerSecond;
+    return uint32_t(clamp<int64_t>(seconds, 1, UINT32_MAX));
+}
+
+int64_t Attributes::ticksOf(uint32_t unixTime) {
+    if (unixTime == 0) return 0;
+    return DirStamp::UnixEpoch + int64_t(unixTime) * DirStamp::TicksPerSecond;
+}
+
+string Attributes::extensionOf(string_view name) {
+    size_t dot = name.rfind('.');
+    if (dot == string_view::npos || dot == 0) return string();
+    return folded(name.substr(dot + 1));
+}
+
+bool AttributeFilter::parse(const string& query, uint32_t now, AttributeFilter& filter, string& rest,
+                            string& error) {
+    filter = AttributeFilter();
+    rest.clear();
+    bool anyTerm = false;
+
+    size_t pos = 0;
+    while (pos < query.size()) {
+        if (query[pos] == ' ') {
+            ++pos;
+            continue;
+        }
+        size_t end = min(query.find(' ', pos), query.size());
+        string_view word(query.data() + pos, end - pos);
+        pos = end;
+
+        size_t colon = word.find(':');
+        string key = colon == string_view::npos ? string() : folded(word.substr(0, colon));
+        if (key == "ext" || key == "type" || key == "size" || key == "modified") {
+            if (!filter.parseTerm(key, word.substr(colon + 1), now, error)) return false;
+            anyTerm = true;
+            continue;
+        }
+        if (!rest.empty()) rest += ' ';
+        rest.append(word);
+    }
+
+    // Without filters the text stays as typed, spaces in a regex included
+    if (!anyTerm) rest = query;
+    return true;
+}
+
+bool AttributeFilter::parseTerm(string_view key, string_view value, uint32_t now, string& error) {
+    if (key == "ext") {
+        forEachWord(value, [&](string_view extension) {
+            if (!extension.empty() && extension[0] == '.') extension.remove_prefix(1);
+            if (!extension.empty() || value.empty()) extensions.push_back(folded(extension));
+        });
+        return true;
+    }
+
+    if (key == "type") {
+        bool files = false, folders = false, unknown = false;
+        forEachWord(value, [&](string_view word) {
+            string name = folded(word);
+            if (name.empty()) return;
+            if (name == "file" || name == "files") {
+                files = true;
+                return;
+            }
+            if (name == "folder" || name == "folders" || name == "dir" || name == "directory") {
+                folders = true;
+                return;
+            }
+            for (const KindGroup& group : KindGroups) {
+                bool found = false;
+                forEachWord(group.names, [&](string_view alias) { found = found || alias == name; });
+                if (found) {
+                    forEachWord(group.extensions, [&](string_view extension) { kinds.emplace_back(extension); });
+                    return;
+                }
+            }
+            error = "type: does not know " + name;
+            unknown = true;
+        });
+        if (unknown) return false;
+        if (files != folders) type = files ? FilesOnly : FoldersOnly;
+        return true;
+    }
+
+    string_view upper;
+    Comparison comparison = comparisonOf(value, upper);
+
+    if (key == "size") {
+        int64_t low, high;
+        if (!bytesOf(value, low) || (comparison == Range && !bytesOf(upper, high))) {
+            error = "size: needs a size like >100M or 10k..2M";
+            return false;
+        }
+
+        int64_t from = 0, to = INT64_MAX;
+        switch (comparison) {
+        case Equal: from = to = low; break;
+        case Less: to = low - 1; break;
+        case LessEqual: to = low; break;
+        case Greater: from = low + 1; break;
+        case GreaterEqual: from = low; break;
+        case Range:
+            from = min(low, high);
+            to = max(low, high);
+            break;
+        }
+
+        sized = true;
+        if (to < 0) {
+            minSize = 1; // nothing is smaller than empty
+            maxSize = 0;
+            return true;
+        }
+        minSize = max(minSize, Attributes::packSize(from));
+        maxSize = min(maxSize, Attributes::packSize(to));
+        return true;
+    }
+
+    // modified:
+    int64_t from, to;
+    bool isAge;
+    bool ok = timeSpan(value, now, from, to, isAge);
+    if (ok && comparison == Range) {
+        int64_t otherFrom, otherTo;
+        ok = timeSpan(upper, now, otherFrom, otherTo, isAge);
+        from = min(from, otherFrom);
+        to = max(to, otherTo);
+    }
+    if (!ok) {
+        error = "modified: needs an age like <7d or a date like 2024-01-31";
+        return false;
+    }
+
+    int64_t low = 0, high = INT64_MAX;
+    if (comparison == Range) {
+        low = from;
+        high = to;
+    } else if (isAge) {
+        // An age counts back from now, so a smaller age is a later time
+        switch (comparison) {
+        case Less: low = from + 1; break;
+        case Greater: high = from - 1; break;
+        case GreaterEqual: high = from; break;
+        default: low = from; break; // a bare age means within it
+        }
+    } else {
+        switch (comparison) {
+        case Less: high = from - 1; break;
+        case LessEqual: high = to; break;
+        case Greater: low = to + 1; break;
+        case GreaterEqual: low = from; break;
+        default:
+            low = from;
+            high = to;
+            break;
+        }
+    }
+
+    dated = true;
+    minTime = max(minTime, uint32_t(clamp<int64_t>(low, 1, UINT32_MAX)));
+    maxTime = min(maxTime, uint32_t(clamp<int64_t>(high, 0, UINT32_MAX)));
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef ATTRIBUTES_H
+#define ATTRIBUTES_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "fsbackend.h"
+
+/*
+Size, modification time and extension of every entry are kept as columns in
+the index, four bytes each for size and time and two for an interned
+extension id, so a filter on them is a scan over a few plain arrays.
+*/
+namespace Attributes {
+
+// Up to 2 GiB exact, above that in KiB, which keeps the order and reaches 2 TiB
+uint32_t packSize(int64_t bytes);
+int64_t unpackSize(uint32_t packed);
+
+// Packed size of a file the listing had no attributes for, no size: term matches it
+const uint32_t UnknownSize = UINT32_MAX;
+
+// Seconds since 1970 of a DirStamp tick count, 0 for an unknown time
+uint32_t unixTime(int64_t ticks);
+int64_t ticksOf(uint32_t unixTime);
+
+// Lower-cased text after the last dot, empty when there is none or the name starts with it
+std::string extensionOf(std::string_view name);
+
+}
+
+/*
+The ext:, type:, size: and modified: terms of a query, everything else is
+left for name matching:
+
+    ext:jpg,png          extension, ext: alone for files without one
+    type:folder          file, folder, or picture, video, audio, document, archive, program, shortcut
+    size:>100M           > >= < <= = or a range 10k..2M, units k m g t count 1024s
+    modified:<7d         an age in h d w m y, < is newer and > older than that,
+    modified:2024-01-31  or a local date, where < is before and > after that day
+*/
+class AttributeFilter {
+public:
+    enum TypeFilter { AnyType, FilesOnly, FoldersOnly };
+
+    // Splits the terms off query into filter, rest gets the other words. now is the Unix time ages
+    // count back from. False with error set when a term can't be read.
+    static bool parse(const std::string& query, uint32_t now, AttributeFilter& filter, std::string& rest,
+                      std::string& error);
+
+    bool empty() const { return type == AnyType && extensions.empty() && kinds.empty() && !sized && !dated; }
+
+    TypeFilter type = AnyType;
+    std::vector<std::string> extensions; // ext:, "" stands for no extension
+    std::vector<std::string> kinds;      // extensions of the type: groups, a file has to be in both lists
+    bool sized = false;                  // size: only ever matches files of known size
+    uint32_t minSize = 0, maxSize = UINT32_MAX; // packed, inclusive
+    bool dated = false;
+    uint32_t minTime = 0, maxTime = UINT32_MAX; // Unix time, inclusive
+
+private:
+    bool parseTerm(std::string_view key, std::string_view value, uint32_t now, std::string& error);
+};
+
+#endif // ATTRIBUTES_H
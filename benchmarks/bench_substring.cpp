@@ -0,0 +1,98 @@
+#include "simdsearch.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <QDebug>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+Compares the old per-path matcher (QFileInfo + QString::contains) with the
+substring kernels running over one case-folded, '\0' separated name buffer.
+Usage: bench_substring [number of names, default 3000000]
+*/
+
+namespace {
+
+const char* const extensions[] = { "txt", "pdf", "png", "exe", "dll", "cpp", "h", "json", "docx", "mp3" };
+
+string randomName(mt19937& rng) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_- ";
+    int length = 4 + int(rng() % 20);
+    string name;
+    for (int i = 0; i < length; ++i)
+        name += letters[rng() % (sizeof(letters) - 1)];
+    name += '.';
+    name += extensions[rng() % (sizeof(extensions) / sizeof(extensions[0]))];
+    return name;
+}
+
+size_t countMatches(SimdSearch::FindFunc kernel, const vector<char>& arena, const string& needle) {
+    const char* p = arena.data();
+    const char* end = p + arena.size();
+    size_t count = 0;
+    while (p < end) {
+        const char* hit = kernel(p, end, needle.data(), needle.size());
+        if (!hit) break;
+        ++count;
+        p = static_cast<const char*>(memchr(hit, '\0', size_t(end - hit))) + 1;
+    }
+    return count;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    size_t total = argc > 1 ? size_t(atoll(argv[1])) : 3000000;
+
+    // Same seed every run so the numbers stay comparable between commits
+    mt19937 rng(20240601);
+    QStringList paths;
+    vector<char> arena;
+    paths.reserve(int(total));
+    for (size_t i = 0; i < total; ++i) {
+        string name = randomName(rng);
+        paths.append(QString("C:\\Users\\bench\\dir%1\\%2").arg(i % 5000).arg(QString::fromStdString(name)));
+        for (char c : name) arena.push_back((c >= 'A' && c <= 'Z') ? char(c + 32) : c);
+        arena.push_back('\0');
+    }
+
+    qInfo().noquote() << "names:" << total << "arena MB:" << arena.size() / 1e6 << "best kernel:" << SimdSearch::kernelName();
+
+    const QStringList queries = { "abc", "report", "x_9", ".pdf", "zzzzqq" };
+    for (const QString& text : queries) {
+        QElapsedTimer timer;
+        timer.start();
+        size_t oldCount = 0;
+        for (const QString& pah : paths) {
+            QString fname = QFileInfo(pah).fileName();
+            if (fname.contains(text, Qt::CaseInsensitive)) ++oldCount;
+        }
+        double oldMs = timer.nsecsElapsed() / 1e6;
+        qInfo().noquote() << QString("%1  mapFunc   %2 ms  matches %3").arg(text, -8).arg(oldMs, 9, 'f', 2).arg(oldCount);
+
+        string needle = text.toLower().toStdString();
+        struct Kernel { const char* name; SimdSearch::FindFunc func; bool usable; };
+        const Kernel kernels[] = {
+            { "scalar", SimdSearch::findScalar, true },
+            { "sse2", SimdSearch::findSse2, SimdSearch::hasSse2() },
+            { "avx2", SimdSearch::findAvx2, SimdSearch::hasAvx2() }
+        };
+        for (const Kernel& kernel : kernels) {
+            if (!kernel.usable) continue;
+            timer.restart();
+            size_t count = countMatches(kernel.func, arena, needle);
+            double ms = timer.nsecsElapsed() / 1e6;
+            qInfo().noquote() << QString("%1  %2 %3 ms  matches %4  %5 GB/s  x%6")
+                                     .arg(text, -8).arg(kernel.name, -9).arg(ms, 9, 'f', 2).arg(count)
+                                     .arg(arena.size() / (ms * 1e6), 0, 'f', 2).arg(oldMs / ms, 0, 'f', 1);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+QT       += core
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench_substring
+
+include(../core/core.pri)
+
+SOURCES += \
+    bench_substring.cpp
@@ -0,0 +1,175 @@
+#include "fileindex.h"
+#include "indexstore.h"
+#include "itembulkloader.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QDebug>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+Renames and then deletes a folder holding many files, and measures how long
+the in-memory index and the parent id table take until a lookup below the
+new name succeeds. The same operations on the old full-path table, where
+every descendant row has to be rewritten, are timed for comparison.
+Usage: bench_subtree [number of files, default 100000]
+*/
+
+namespace {
+
+const size_t FilesPerFolder = 1000;
+
+string join(const string& folder, const string& name) {
+    return folder + FileIndex::Separator + name;
+}
+
+string benchRoot() {
+    return FileIndex::Separator == '\\' ? string("C:\\bench") : string("/bench");
+}
+
+bool exec(QSqlQuery& query, const QString& sql) {
+    if (query.exec(sql)) return true;
+    qWarning() << sql << query.lastError().text();
+    return false;
+}
+
+double elapsedMs(QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1e6;
+}
+
+void report(const char* what, double ms) {
+    qInfo().noquote() << QString("%1 %2 ms").arg(what, -40).arg(ms, 10, 'f', 3);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    size_t total = argc > 1 ? size_t(atoll(argv[1])) : 100000;
+
+    const string oldFolder = join(benchRoot(), "project");
+    const string newFolder = join(benchRoot(), "project-renamed");
+    const string probeName = "sub0" + string(1, FileIndex::Separator) + "file0.txt";
+
+    FileIndex index;
+    vector<string> paths;
+    paths.reserve(total);
+    for (size_t i = 0; i < total; ++i) {
+        string folder = join(oldFolder, "sub" + to_string(i / FilesPerFolder));
+        paths.push_back(join(folder, "file" + to_string(i % FilesPerFolder) + ".txt"));
+    }
+
+    index.beginBulkLoad();
+    for (const string& path : paths)
+        index.addPath(path, 'f');
+    index.endBulkLoad(2);
+
+    QString dbPath = QDir::temp().filePath("bench_subtree.db");
+    QFile::remove(dbPath);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(dbPath);
+    if (!db.open()) {
+        qWarning() << "Can't open" << dbPath << db.lastError().text();
+        return 1;
+    }
+
+    ItemBulkLoader loader(db);
+    if (!loader.begin()) return 1;
+    loader.addFromIndex(index, 0, index.endId());
+    loader.commit();
+    if (!loader.finish()) return 1;
+
+    QSqlQuery query(db);
+    exec(query, "CREATE TABLE legacy (path TEXT PRIMARY KEY, type TEXT NOT NULL)");
+    db.transaction();
+    query.prepare("INSERT INTO legacy (path, type) VALUES (?, 'f')");
+    for (const string& path : paths) {
+        query.addBindValue(QString::fromStdString(path));
+        query.exec();
+    }
+    db.commit();
+
+    qInfo().noquote() << "files:" << total << "folders:" << (total + FilesPerFolder - 1) / FilesPerFolder
+                      << "entries:" << index.endId();
+
+    IndexStore store(db);
+    store.ensureSchema();
+    QElapsedTimer timer;
+
+    // In-memory index: the folder entry moves, its children keep pointing at it
+    timer.start();
+    index.renamePath(oldFolder, newFolder);
+    bool consistent = index.find(join(newFolder, probeName)) != FileIndex::NoParent
+                      && index.find(join(oldFolder, probeName)) == FileIndex::NoParent;
+    report("index rename until lookup succeeds", elapsedMs(timer));
+    if (!consistent) qWarning() << "index lookup after rename failed";
+
+    timer.restart();
+    vector<uint32_t> hits = index.search("file0.txt", 10);
+    bool renamedHits = !hits.empty();
+    for (uint32_t id : hits)
+        renamedHits = renamedHits && index.pathOf(id).compare(0, newFolder.size(), newFolder) == 0;
+    report("index search after rename", elapsedMs(timer));
+    if (!renamedHits) qWarning() << "search after rename returned stale paths";
+
+    // Parent id table: one row update
+    timer.restart();
+    db.transaction();
+    store.renamePath(QString::fromStdString(oldFolder), QString::fromStdString(newFolder));
+    db.commit();
+    consistent = store.idOf(QString::fromStdString(join(newFolder, probeName))) != 0;
+    report("items rename until lookup succeeds", elapsedMs(timer));
+    if (!consistent) qWarning() << "items lookup after rename failed";
+
+    // Full-path table: every descendant path is rewritten
+    QString oldPrefix = QString::fromStdString(oldFolder + FileIndex::Separator);
+    QString newPrefix = QString::fromStdString(newFolder + FileIndex::Separator);
+    timer.restart();
+    db.transaction();
+    query.prepare("UPDATE legacy SET path = ? || substr(path, ?) WHERE path >= ? AND path < ?");
+    query.addBindValue(newPrefix);
+    query.addBindValue(oldPrefix.size() + 1);
+    query.addBindValue(oldPrefix);
+    query.addBindValue(oldPrefix.left(oldPrefix.size() - 1) + QChar(FileIndex::Separator + 1));
+    if (!query.exec()) qWarning() << query.lastError().text();
+    db.commit();
+    report("legacy prefix rewrite", elapsedMs(timer));
+
+    // Delete the renamed folder with everything below it
+    timer.restart();
+    index.removePath(newFolder);
+    consistent = index.find(join(newFolder, probeName)) == FileIndex::NoParent && index.search("file0.txt", 10).empty();
+    report("index subtree delete until search is empty", elapsedMs(timer));
+    if (!consistent) qWarning() << "index still finds deleted entries";
+
+    timer.restart();
+    db.transaction();
+    store.removePath(QString::fromStdString(newFolder));
+    db.commit();
+    report("items subtree delete", elapsedMs(timer));
+
+    query.exec("SELECT COUNT(*) FROM items");
+    if (query.next() && query.value(0).toLongLong() > 2)
+        qWarning() << "items still holds" << query.value(0).toLongLong() << "rows";
+
+    timer.restart();
+    db.transaction();
+    query.prepare("DELETE FROM legacy WHERE path >= ? AND path < ?");
+    query.addBindValue(newPrefix);
+    query.addBindValue(newPrefix.left(newPrefix.size() - 1) + QChar(FileIndex::Separator + 1));
+    if (!query.exec()) qWarning() << query.lastError().text();
+    db.commit();
+    report("legacy prefix delete", elapsedMs(timer));
+
+    db.close();
+    QFile::remove(dbPath);
+    return 0;
+}
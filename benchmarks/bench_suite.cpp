@@ -0,0 +1,462 @@
+#include "fileindex.h"
+#include "fswatcher.h"
+#include "indexer.h"
+#include "indexstore.h"
+#include "indexwriter.h"
+#include "searchengine.h"
+#include "treegen.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+The numbers that matter for every change to indexing or search, on a tree
+that is the same on every machine and every run:
+scan entries/s, files.db load rows/s, snapshot map time, index sizes,
+p50/p99 latency of a fixed query mix, and how long a created, renamed or
+deleted file takes until a lookup sees it.
+The scan runs on a tree generated in memory, so it measures the indexer and
+not the disk. The watcher needs real events and uses a small tree on disk,
+which is also scanned with and without reading size and time of every file.
+JSON goes to stdout, a readable summary to stderr.
+
+Usage: bench_suite [--entries N] [--depth N] [--fanout N] [--name-mean N] [--name-stddev N]
+                   [--seed N] [--rounds N] [--watch-files N] [--watch-ops N] [--threads N] [--label TEXT]
+*/
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+const size_t MaxResults = 100;
+const int WatchTimeoutMs = 10000;
+
+struct Options {
+    TreeShape shape;
+    size_t rounds = 20;       // passes over the query mix
+    uint64_t watchFiles = 2000; // entries in the on-disk tree, 0 skips the watcher
+    size_t watchOps = 50;     // creates, renames and deletes each
+    unsigned int threads = 0;
+    QString label;
+};
+
+double msSince(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// Nearest rank, so p99 of 20 samples is the slowest one
+double percentile(vector<double> samples, double p) {
+    if (samples.empty()) return 0;
+    sort(samples.begin(), samples.end());
+    size_t rank = size_t(ceil(p * samples.size()));
+    return samples[min(max<size_t>(rank, 1), samples.size()) - 1];
+}
+
+QJsonObject latencies(const vector<double>& samples) {
+    QJsonObject out;
+    out["count"] = qint64(samples.size());
+    out["p50_ms"] = percentile(samples, 0.50);
+    out["p99_ms"] = percentile(samples, 0.99);
+    out["max_ms"] = samples.empty() ? 0.0 : *max_element(samples.begin(), samples.end());
+    return out;
+}
+
+void report(const QString& what, const QString& value) {
+    qInfo().noquote() << QString("%1 %2").arg(what, -36).arg(value);
+}
+
+QString perSecond(double count, double ms) {
+    return QString("%1/s").arg(ms > 0 ? count * 1000 / ms : 0, 0, 'f', 0);
+}
+
+string benchRoot() {
+    return FileIndex::Separator == '\\' ? string("C:\\bench") : string("/bench");
+}
+
+bool parseOptions(const QStringList& arguments, Options& options) {
+    for (int i = 1; i < arguments.size(); ++i) {
+        const QString& arg = arguments[i];
+        if (i + 1 >= arguments.size()) return false;
+        const QString& value = arguments[++i];
+        if (arg == "--entries") options.shape.entries = value.toULongLong();
+        else if (arg == "--depth") options.shape.depth = value.toUInt();
+        else if (arg == "--fanout") options.shape.fanout = value.toUInt();
+        else if (arg == "--name-mean") options.shape.nameMean = value.toDouble();
+        else if (arg == "--name-stddev") options.shape.nameStddev = value.toDouble();
+        else if (arg == "--seed") options.shape.seed = value.toULongLong();
+        else if (arg == "--rounds") options.rounds = value.toULongLong();
+        else if (arg == "--watch-files") options.watchFiles = value.toULongLong();
+        else if (arg == "--watch-ops") options.watchOps = value.toULongLong();
+        else if (arg == "--threads") options.threads = value.toUInt();
+        else if (arg == "--label") options.label = value;
+        else return false;
+    }
+    return true;
+}
+
+qint64 snapshotBytes(const IndexPaths& paths) {
+    QFileInfo base(paths.snapshot);
+    qint64 bytes = 0;
+    for (const QFileInfo& file : base.dir().entryInfoList({ base.fileName() + ".*" }, QDir::Files))
+        bytes += file.size();
+    return bytes;
+}
+
+struct Query {
+    const char* kind;
+    string text;
+    bool fuzzy = false;
+};
+
+// Every other character, the way a name gets abbreviated for fuzzy search
+string abbreviate(const string& name) {
+    string out;
+    for (size_t i = 0; i < name.size(); i += 2)
+        out += name[i];
+    return out;
+}
+
+// Picked from the vocabulary and the tree, so the mix only changes with the seed
+vector<Query> queryMix(const SyntheticTree& tree) {
+    const vector<string>& words = tree.vocabulary();
+    uint64_t last = tree.folderCount() - 1;
+    auto someName = [&](uint64_t folder) { return tree.filesIn(folder) ? tree.fileName(folder, 0) : words[3]; };
+
+    return {
+        { "common_word", words[0] },
+        { "common_word", words[1] },
+        { "common_word", words[4] },
+        { "rare_word", words[words.size() * 3 / 4] },
+        { "rare_word", words[words.size() - 1] },
+        { "short", words[2].substr(0, 2) },
+        { "short", words[7].substr(0, 3) },
+        { "extension", ".pdf" },
+        { "extension", ".cpp" },
+        { "exact_name", someName(last) },
+        { "exact_name", someName(last / 2) },
+        { "no_match", "qqzxj" },
+        { "glob", "*.pdf" },
+        { "glob", words[0] + "*.txt" },
+        { "regex", "regex:^" + words[1] + ".*[0-9]" },
+        { "regex", "regex:\\d{3}\\." },
+        { "fuzzy", abbreviate(someName(last)), true },
+        { "fuzzy", abbreviate(words[5] + words[6]), true },
+        // Generated files are dated in the three years up to November 2023
+        { "filter", "ext:pdf" },
+        { "filter", "size:>100M" },
+        { "filter", "type:picture modified:>2023-01-01" },
+        { "filter", words[0] + " ext:docx,xlsx size:<1M" },
+    };
+}
+
+// Cold queries on a fresh session each, then one name typed a key at a time on the same session
+void runQueries(const FileIndex& index, const SyntheticTree& tree, size_t rounds, QJsonObject& out) {
+    vector<Query> mix = queryMix(tree);
+    map<string, vector<double>> byKind;
+    vector<double> all;
+    vector<double> typing;
+    QJsonArray stages; // prefilter and matcher of the glob, regex and filter queries
+
+    string typed = tree.filesIn(0) ? tree.fileName(0, 0) : tree.vocabulary()[3];
+    for (size_t round = 0; round < rounds; ++round) {
+        for (const Query& query : mix) {
+            SearchEngine engine(index);
+            engine.setFuzzy(query.fuzzy);
+            Clock::time_point start = Clock::now();
+            engine.run(engine.start(), query.text, MaxResults, [](const vector<uint32_t>&, bool) {});
+            double ms = msSince(start);
+            byKind[query.kind].push_back(ms);
+            all.push_back(ms);
+
+            FileIndex::FilterStats filter = engine.lastFilter();
+            if (round == 0 && filter.candidates > 0) {
+                stages.append(QJsonObject{ { "text", QString::fromStdString(query.text) },
+                                           { "candidates", qint64(filter.candidates) },
+                                           { "matches", qint64(filter.matches) },
+                                           { "prefilter_ms", filter.prefilterMs },
+                                           { "verify_ms", filter.verifyMs } });
+            }
+        }
+
+        SearchEngine engine(index);
+        for (size_t length = 1; length <= typed.size(); ++length) {
+            Clock::time_point start = Clock::now();
+            engine.run(engine.start(), typed.substr(0, length), MaxResults, [](const vector<uint32_t>&, bool) {});
+            typing.push_back(msSince(start));
+        }
+    }
+
+    QJsonObject kinds;
+    for (const auto& [kind, samples] : byKind)
+        kinds[QString::fromStdString(kind)] = latencies(samples);
+    QJsonArray texts;
+    for (const Query& query : mix)
+        texts.append(QJsonObject{ { "kind", query.kind }, { "text", QString::fromStdString(query.text) } });
+
+    out["mix"] = texts;
+    out["all"] = latencies(all);
+    out["by_kind"] = kinds;
+    out["typing"] = latencies(typing);
+    out["pattern_stages"] = stages;
+
+    report("query p50 / p99", QString("%1 / %2 ms").arg(percentile(all, 0.5), 0, 'f', 3).arg(percentile(all, 0.99), 0, 'f', 3));
+    report("typing p50 / p99", QString("%1 / %2 ms").arg(percentile(typing, 0.5), 0, 'f', 3).arg(percentile(typing, 0.99), 0, 'f', 3));
+}
+
+// Milliseconds until visible holds, -1 when it never did
+double waitFor(Clock::time_point since, const function<bool()>& visible) {
+    while (!visible()) {
+        if (msSince(since) > WatchTimeoutMs) return -1;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return msSince(since);
+}
+
+/*
+Event to visible through the same watcher and writer DriveWatcher uses.
+Creates go to the writer at once: DriveWatcher holds them back for
+CreateDelay on purpose, which would only add a constant here.
+*/
+bool runWatcher(const Options& options, const QString& folder, QJsonObject& out) {
+    TreeShape shape = options.shape;
+    shape.entries = options.watchFiles;
+    shape.depth = min(shape.depth, 2u);
+    string root = QDir(folder).filePath("tree").toStdString();
+    SyntheticTree tree(shape, QDir::toNativeSeparators(QString::fromStdString(root)).toStdString());
+    if (!tree.materialize()) {
+        qWarning() << "Can't write the watcher tree below" << folder;
+        return false;
+    }
+
+    // The same tree listed with and without a stat per file, warm in the page cache both times
+    double attributesMs = 0;
+    {
+        FileIndex listed;
+        QDir().mkpath(QDir(folder).filePath("attributes"));
+        Indexer indexer(listed, IndexPaths::in(QDir(folder).filePath("attributes")), options.threads);
+        indexer.setBackend(rootedBackend({ tree.root() }, true));
+        indexer.scan();
+        attributesMs = indexer.lastScan().scanMs;
+    }
+
+    FileIndex index;
+    IndexPaths paths = IndexPaths::in(QDir(folder).filePath("watch"));
+    QDir().mkpath(QDir(folder).filePath("watch"));
+    Indexer indexer(index, paths, options.threads);
+    indexer.setBackend(rootedBackend({ tree.root() }));
+    indexer.scan();
+    double scanMs = indexer.lastScan().scanMs;
+
+    unique_ptr<FsWatcher> watcher = FsWatcher::create({ tree.root() });
+    if (!watcher) {
+        qWarning() << "No file system watcher available";
+        return false;
+    }
+    IndexWriter writer(index, paths.database, QString());
+    writer.start();
+    thread watchThread([&] {
+        watcher->run([&](vector<FsEvent>& batch) {
+            for (FsEvent& event : batch) {
+                char type = event.isDir ? 'd' : 'f';
+                if (event.kind == FsEvent::Created)
+                    writer.submit({ FileIndex::Change::Add, move(event.path), {}, type });
+                else if (event.kind == FsEvent::Deleted)
+                    writer.submit({ FileIndex::Change::Remove, move(event.path), {}, type });
+                else if (event.kind == FsEvent::Renamed)
+                    writer.submit({ FileIndex::Change::Rename, move(event.path), move(event.oldPath), type });
+            }
+        });
+    });
+    // inotify and fanotify are watching once create() returned, give run() its first poll
+    this_thread::sleep_for(chrono::milliseconds(FsWatcher::PollMs * 2));
+
+    vector<double> created, renamed, deleted;
+    size_t timeouts = 0;
+    auto record = [&](vector<double>& samples, double ms) {
+        if (ms < 0) ++timeouts;
+        else samples.push_back(ms);
+    };
+
+    string dir = tree.pathOf(tree.folderCount() - 1);
+    for (size_t i = 0; i < options.watchOps; ++i) {
+        string path = dir + FileIndex::Separator + "watched" + to_string(i) + ".txt";
+        string moved = dir + FileIndex::Separator + "moved" + to_string(i) + ".txt";
+
+        Clock::time_point start = Clock::now();
+        QFile file(QString::fromStdString(path));
+        file.open(QIODevice::WriteOnly);
+        file.close();
+        record(created, waitFor(start, [&] { return index.find(path) != FileIndex::NoParent; }));
+
+        start = Clock::now();
+        QFile::rename(QString::fromStdString(path), QString::fromStdString(moved));
+        record(renamed, waitFor(start, [&] { return index.find(moved) != FileIndex::NoParent; }));
+
+        start = Clock::now();
+        QFile::remove(QString::fromStdString(moved));
+        record(deleted, waitFor(start, [&] { return index.find(moved) == FileIndex::NoParent; }));
+    }
+
+    watcher->stop();
+    watchThread.join();
+    writer.stop();
+
+    out["backend"] = watcher->name();
+    out["entries"] = qint64(index.size());
+    out["disk_scan_ms"] = scanMs;
+    out["disk_scan_attributes_ms"] = attributesMs;
+    out["create"] = latencies(created);
+    out["rename"] = latencies(renamed);
+    out["delete"] = latencies(deleted);
+    out["timeouts"] = qint64(timeouts);
+    out["commits"] = qint64(writer.stats().commits);
+
+    report("disk scan / with attributes", QString("%1 / %2 ms").arg(scanMs, 0, 'f', 1).arg(attributesMs, 0, 'f', 1));
+    report("watcher", watcher->name());
+    report("create / rename / delete p50", QString("%1 / %2 / %3 ms").arg(percentile(created, 0.5), 0, 'f', 1)
+               .arg(percentile(renamed, 0.5), 0, 'f', 1).arg(percentile(deleted, 0.5), 0, 'f', 1));
+    report("create / rename / delete p99", QString("%1 / %2 / %3 ms").arg(percentile(created, 0.99), 0, 'f', 1)
+               .arg(percentile(renamed, 0.99), 0, 'f', 1).arg(percentile(deleted, 0.99), 0, 'f', 1));
+    if (timeouts) qWarning() << timeouts << "changes never became visible";
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    Options options;
+    if (!parseOptions(app.arguments(), options)) {
+        qWarning().noquote() << "usage: bench_suite [--entries N] [--depth N] [--fanout N] [--name-mean N]"
+                                " [--name-stddev N] [--seed N] [--rounds N] [--watch-files N] [--watch-ops N]"
+                                " [--threads N] [--label TEXT]";
+        return 2;
+    }
+
+    QTemporaryDir temp;
+    if (!temp.isValid()) {
+        qWarning() << "Can't create a temporary folder";
+        return 1;
+    }
+    unsigned int threads = options.threads ? options.threads : max(thread::hardware_concurrency(), 1u);
+    IndexPaths paths = IndexPaths::in(temp.path());
+    SyntheticTree tree(options.shape, benchRoot());
+    const TreeShape& shape = tree.shape();
+
+    QJsonObject result;
+    result["label"] = options.label;
+    result["tree"] = QJsonObject{
+        { "seed", QString::number(shape.seed) }, { "depth", int(shape.depth) }, { "fanout", int(shape.fanout) },
+        { "folders", qint64(tree.folderCount()) }, { "files", qint64(tree.fileCount()) },
+        { "name_mean", shape.nameMean }, { "name_stddev", shape.nameStddev },
+    };
+    report("tree", QString("%1 folders, %2 files, depth %3, fanout %4")
+                       .arg(tree.folderCount()).arg(tree.fileCount()).arg(shape.depth).arg(shape.fanout));
+
+    // Scan, pipelined into files.db, then written out as a snapshot
+    FileIndex scanned;
+    {
+        Indexer indexer(scanned, paths, options.threads);
+        indexer.setBackend(tree.backend());
+        Clock::time_point start = Clock::now();
+        indexer.scan();
+        double totalMs = msSince(start);
+
+        const Indexer::ScanStats& scan = indexer.lastScan();
+        result["scan"] = QJsonObject{
+            { "entries", qint64(scan.entries) }, { "ms", scan.scanMs },
+            { "entries_per_second", scan.scanMs > 0 ? scan.entries * 1000 / scan.scanMs : 0.0 },
+            { "rows", qint64(scan.rows) }, { "rows_per_second", scan.rowsPerSecond },
+            { "with_snapshot_ms", totalMs },
+        };
+        report("scan", QString("%1 entries in %2 ms, %3").arg(scan.entries).arg(scan.scanMs, 0, 'f', 1)
+                           .arg(perSecond(scan.entries, scan.scanMs)));
+        report("files.db rows written", QString("%1, %2/s").arg(scan.rows).arg(scan.rowsPerSecond, 0, 'f', 0));
+    }
+    scanned.clear();
+
+    // files.db into an empty index, what a start without a snapshot costs
+    FileIndex loaded;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "bench-load");
+        db.setDatabaseName(paths.database);
+        if (!db.open()) {
+            qWarning() << "Can't open" << paths.database << db.lastError().text();
+            return 1;
+        }
+        IndexStore store(db);
+        Clock::time_point start = Clock::now();
+        bool ok = store.load(loaded, threads);
+        double ms = msSince(start);
+        db.close();
+        if (!ok) qWarning() << "Loading files.db failed";
+
+        result["load"] = QJsonObject{
+            { "rows", qint64(loaded.size()) }, { "ms", ms }, { "rows_per_second", ms > 0 ? loaded.size() * 1000 / ms : 0.0 },
+        };
+        report("files.db load", QString("%1 rows in %2 ms, %3").arg(loaded.size()).arg(ms, 0, 'f', 1)
+                                    .arg(perSecond(loaded.size(), ms)));
+    }
+    QSqlDatabase::removeDatabase("bench-load");
+
+    // The snapshot is mapped, not read, opening checks the checksums once and verifying times that alone
+    FileIndex mapped;
+    {
+        Clock::time_point start = Clock::now();
+        bool ok = mapped.openSnapshot(paths.snapshot.toStdString());
+        double mapMs = msSince(start);
+        start = Clock::now();
+        bool intact = ok && mapped.verifySnapshot();
+        double verifyMs = msSince(start);
+        if (!intact) qWarning() << "Snapshot did not open or verify";
+
+        result["snapshot"] = QJsonObject{ { "open_ms", mapMs }, { "verify_ms", verifyMs }, { "ok", intact } };
+        report("snapshot open / verify", QString("%1 / %2 ms").arg(mapMs, 0, 'f', 2).arg(verifyMs, 0, 'f', 1));
+    }
+
+    result["size"] = QJsonObject{
+        { "entries", qint64(loaded.size()) },
+        { "heap_bytes", qint64(loaded.memoryUsage()) },
+        { "mapped_heap_bytes", qint64(mapped.memoryUsage()) },
+        { "snapshot_bytes", snapshotBytes(paths) },
+        { "database_bytes", QFileInfo(paths.database).size() },
+    };
+    report("index heap / mapped heap", QString("%1 / %2 MB").arg(loaded.memoryUsage() / 1048576.0, 0, 'f', 1)
+                                           .arg(mapped.memoryUsage() / 1048576.0, 0, 'f', 1));
+    report("snapshot / files.db", QString("%1 / %2 MB").arg(snapshotBytes(paths) / 1048576.0, 0, 'f', 1)
+                                      .arg(QFileInfo(paths.database).size() / 1048576.0, 0, 'f', 1));
+    mapped.clear();
+
+    QJsonObject queries;
+    runQueries(loaded, tree, options.rounds, queries);
+    result["query"] = queries;
+    loaded.clear();
+
+    if (options.watchFiles > 0) {
+        QJsonObject watch;
+        if (runWatcher(options, temp.path(), watch)) result["watch"] = watch;
+    }
+
+    QByteArray json = QJsonDocument(result).toJson(QJsonDocument::Indented);
+    fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    return 0;
+}
@@ -0,0 +1,16 @@
+QT       += core sql
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench_suite
+
+include(../core/core.pri)
+
+SOURCES += \
+    bench_suite.cpp \
+    treegen.cpp
+
+HEADERS += \
+    treegen.h
@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+# Each benchmark links the core library, build them from vulture.pro so it is there
+SUBDIRS += \
+    bench_substring.pro \
+    bench_subtree.pro \
+    bench_suite.pro
@@ -0,0 +1,290 @@
+#include "treegen.h"
+#include "fileindex.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace {
+
+const char* const Syllables[] = {
+    "ba", "be", "bo", "ca", "co", "da", "de", "di", "do", "fa", "fe", "fi", "ga", "go", "ha", "he",
+    "ja", "ka", "ke", "la", "le", "li", "lo", "lu", "ma", "me", "mi", "mo", "na", "ne", "no", "nu",
+    "pa", "pe", "pi", "po", "ra", "re", "ri", "ro", "sa", "se", "si", "so", "ta", "te", "ti", "to",
+    "va", "ve", "vi", "wa", "xe", "ya", "za", "zo", "ar", "en", "in", "on", "or", "st", "th", "ch",
+};
+const size_t SyllableCount = sizeof(Syllables) / sizeof(Syllables[0]);
+
+// Roughly how often each kind of file shows up on a desktop machine
+struct Extension {
+    const char* name;
+    unsigned int weight;
+};
+const Extension Extensions[] = {
+    { "txt", 10 }, { "jpg", 12 }, { "png", 8 }, { "pdf", 6 }, { "docx", 4 }, { "xlsx", 2 },
+    { "mp3", 5 },  { "mp4", 3 },  { "zip", 2 }, { "dll", 9 }, { "exe", 3 },  { "h", 8 },
+    { "cpp", 7 },  { "js", 6 },   { "json", 5 }, { "xml", 4 }, { "log", 3 }, { "dat", 2 },
+};
+
+const size_t VocabularySize = 2048;
+const int64_t BaseTime = 1700000000 * DirStamp::TicksPerSecond;
+
+// splitmix64, a good enough hash and a cheap generator in one
+uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+    uint64_t next() { return mix(state++); }
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    size_t below(size_t n) { return size_t(next() % n); }
+
+private:
+    uint64_t state;
+};
+
+class SyntheticBackend : public FsBackend {
+public:
+    class Folder : public Directory {
+    public:
+        explicit Folder(uint64_t id) : id(id) {}
+        uint64_t id;
+    };
+
+    explicit SyntheticBackend(const SyntheticTree& tree) : tree(tree) {}
+
+    char separator() const override { return FileIndex::Separator; }
+    vector<string> roots() const override { return { tree.root() }; }
+
+    DirectoryRef open(const DirectoryRef& parent, const string& name, const string& path) const override {
+        if (parent) return child(static_cast<const Folder&>(*parent).id, name);
+
+        // Without a parent the path is walked down from the root
+        const string& root = tree.root();
+        if (path.compare(0, root.size(), root) != 0) return nullptr;
+        DirectoryRef dir = make_shared<Folder>(0);
+        size_t pos = root.size();
+        while (dir && pos < path.size()) {
+            if (path[pos] == separator()) {
+                ++pos;
+                continue;
+            }
+            size_t end = min(path.find(separator(), pos), path.size());
+            dir = child(static_cast<const Folder&>(*dir).id, path.substr(pos, end - pos));
+            pos = end;
+        }
+        return dir;
+    }
+
+    void list(const DirectoryRef& dir, const EntryCallback& onEntry) const override {
+        uint64_t id = static_cast<const Folder&>(*dir).id;
+        for (unsigned int i = 0, n = tree.foldersIn(id); i < n; ++i) {
+            FileAttributes attributes;
+            attributes.mtime = DirStamp::UnixEpoch + BaseTime + int64_t(tree.childFolder(id, i));
+            onEntry(tree.folderName(id, i), true, attributes);
+        }
+        for (uint64_t i = 0, n = tree.filesIn(id); i < n; ++i)
+            onEntry(tree.fileName(id, i), false, tree.fileAttributes(id, i));
+    }
+
+    // Nothing ever changes, so a reconcile after a scan lists no folder
+    bool stamp(const DirectoryRef& dir, DirStamp& out) const override {
+        out.mtime = BaseTime + int64_t(static_cast<const Folder&>(*dir).id);
+        out.size = 0;
+        return true;
+    }
+
+    // Only listings are served, nothing watches a synthetic tree
+    bool attributesOf(const string&, FileAttributes&) const override { return false; }
+
+    int64_t now() const override { return BaseTime + int64_t(tree.folderCount()) + 1; }
+
+private:
+    DirectoryRef child(uint64_t id, const string& name) const {
+        for (unsigned int i = 0, n = tree.foldersIn(id); i < n; ++i) {
+            if (tree.folderName(id, i) == name) return make_shared<Folder>(tree.childFolder(id, i));
+        }
+        return nullptr;
+    }
+
+    const SyntheticTree& tree;
+};
+
+class RootedBackend : public FsBackend {
+public:
+    RootedBackend(unique_ptr<FsBackend> real, vector<string> roots) : real(move(real)), rootList(move(roots)) {}
+
+    char separator() const override { return real->separator(); }
+    vector<string> roots() const override { return rootList; }
+    DirectoryRef open(const DirectoryRef& parent, const string& name, const string& path) const override {
+        return real->open(parent, name, path);
+    }
+    void list(const DirectoryRef& dir, const EntryCallback& onEntry) const override { real->list(dir, onEntry); }
+    bool stamp(const DirectoryRef& dir, DirStamp& out) const override { return real->stamp(dir, out); }
+    bool attributesOf(const string& path, FileAttributes& out) const override { return real->attributesOf(path, out); }
+    int64_t now() const override { return real->now(); }
+
+private:
+    unique_ptr<FsBackend> real;
+    vector<string> rootList;
+};
+
+}
+
+SyntheticTree::SyntheticTree(const TreeShape& shape, string root) : treeShape(shape), rootPath(move(root)) {
+    treeShape.fanout = max(treeShape.fanout, 1u);
+
+    // Levels stop once the folders alone would be more than the entries asked for
+    uint64_t level = 1;
+    unsigned int depth = 0;
+    while (depth < treeShape.depth) {
+        uint64_t next = level * treeShape.fanout;
+        if (folders + next > max<uint64_t>(treeShape.entries, 1)) break;
+        innerFolders = folders;
+        folders += next;
+        level = next;
+        ++depth;
+    }
+    treeShape.depth = depth;
+
+    Random random(mix(treeShape.seed));
+    words.reserve(VocabularySize);
+    while (words.size() < VocabularySize) {
+        string word;
+        for (size_t n = 1 + random.below(3); n > 0; --n)
+            word += Syllables[random.below(SyllableCount)];
+        if (find(words.begin(), words.end(), word) == words.end()) words.push_back(move(word));
+    }
+}
+
+uint64_t SyntheticTree::fileCount() const {
+    return treeShape.entries > folders ? treeShape.entries - folders : 0;
+}
+
+unsigned int SyntheticTree::foldersIn(uint64_t folder) const {
+    return folder < innerFolders ? treeShape.fanout : 0;
+}
+
+uint64_t SyntheticTree::filesIn(uint64_t folder) const {
+    uint64_t files = fileCount();
+    return files / folders + (folder < files % folders ? 1 : 0);
+}
+
+string SyntheticTree::folderName(uint64_t folder, unsigned int i) const {
+    return makeName(folder, i, true);
+}
+
+string SyntheticTree::fileName(uint64_t folder, uint64_t i) const {
+    return makeName(folder, i, false);
+}
+
+FileAttributes SyntheticTree::fileAttributes(uint64_t folder, uint64_t i) const {
+    const int64_t ThreeYears = 3 * 365 * 86400;
+    Random random(mix(treeShape.seed ^ mix(folder * 2 + 1) ^ mix(~i)));
+    FileAttributes attributes;
+    attributes.size = int64_t(pow(2.0, random.uniform() * 30));
+    attributes.mtime = DirStamp::UnixEpoch + BaseTime - int64_t(random.below(ThreeYears)) * DirStamp::TicksPerSecond;
+    return attributes;
+}
+
+string SyntheticTree::pathOf(uint64_t folder) const {
+    vector<string> names;
+    while (folder != 0) {
+        uint64_t parent = (folder - 1) / treeShape.fanout;
+        names.push_back(folderName(parent, unsigned((folder - 1) % treeShape.fanout)));
+        folder = parent;
+    }
+
+    string path = rootPath;
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+        if (path.empty() || path.back() != FileIndex::Separator) path += FileIndex::Separator;
+        path += *it;
+    }
+    return path;
+}
+
+/*
+Words picked with a skew towards the start of the vocabulary, so some words
+are in many names and most are in few, like real trees. The position ends
+every name, which keeps names unique within their folder.
+*/
+string SyntheticTree::makeName(uint64_t folder, uint64_t i, bool isDir) const {
+    Random random(mix(treeShape.seed ^ mix(folder * 2 + (isDir ? 1 : 0))) ^ mix(i));
+
+    // Box-Muller, the length only needs to be roughly normal
+    double u = max(random.uniform(), 1e-12);
+    double normal = sqrt(-2 * log(u)) * cos(6.283185307179586 * random.uniform());
+    string number = to_string(i);
+    long length = lround(treeShape.nameMean + normal * treeShape.nameStddev);
+    size_t prefix = size_t(clamp(length - long(number.size()), 1L, 200L));
+
+    static const char* const Separators[] = { "_", "-", " ", "" };
+    const char* separator = Separators[random.below(4)];
+    bool title = random.below(3) == 0;
+
+    string name;
+    while (name.size() < prefix) {
+        double skew = random.uniform();
+        string word = words[size_t(words.size() * skew * skew * skew)];
+        if (title) word[0] = char(toupper(static_cast<unsigned char>(word[0])));
+        if (!name.empty()) name += separator;
+        name += word;
+    }
+    name.resize(prefix);
+    while (!isalpha(static_cast<unsigned char>(name.back())))
+        name.pop_back();
+    name += number;
+
+    if (!isDir) {
+        unsigned int total = 0;
+        for (const Extension& extension : Extensions)
+            total += extension.weight;
+        size_t pick = random.below(total);
+        for (const Extension& extension : Extensions) {
+            if (pick < extension.weight) {
+                name += '.';
+                name += extension.name;
+                break;
+            }
+            pick -= extension.weight;
+        }
+    }
+    return name;
+}
+
+unique_ptr<FsBackend> SyntheticTree::backend() const {
+    return make_unique<SyntheticBackend>(*this);
+}
+
+bool SyntheticTree::materialize() const {
+    namespace fs = std::filesystem;
+    error_code error;
+    vector<uint64_t> stack = { 0 };
+    while (!stack.empty()) {
+        uint64_t folder = stack.back();
+        stack.pop_back();
+
+        fs::path dir = fs::u8path(pathOf(folder));
+        fs::create_directories(dir, error);
+        if (error) return false;
+        for (uint64_t i = 0, n = filesIn(folder); i < n; ++i) {
+            ofstream file(dir / fs::u8path(fileName(folder, i)));
+            if (!file) return false;
+        }
+        for (unsigned int i = 0, n = foldersIn(folder); i < n; ++i)
+            stack.push_back(childFolder(folder, i));
+    }
+    return true;
+}
+
+unique_ptr<FsBackend> rootedBackend(vector<string> roots, bool listAttributes) {
+    return make_unique<RootedBackend>(FsBackend::create(listAttributes), move(roots));
+}
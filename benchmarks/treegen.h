@@ -0,0 +1,67 @@
+#ifndef TREEGEN_H
+#define TREEGEN_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "fsbackend.h"
+
+// Shape of a synthetic tree, the same shape and seed always give the same names
+struct TreeShape {
+    uint64_t seed = 20240601;
+    unsigned int depth = 4;     // folder levels below the root
+    unsigned int fanout = 8;    // folders in every folder above the last level
+    uint64_t entries = 1000000; // files and folders together
+    double nameMean = 14;       // name length before the extension
+    double nameStddev = 6;
+};
+
+/*
+A file tree that only exists as a function of its shape. Folders are numbered
+like a complete fanout-ary tree, every name is derived from the seed and its
+position, so even 10M entries take no memory until something lists them.
+Names are built from a fixed vocabulary, which is where query mixes come from.
+*/
+class SyntheticTree {
+public:
+    SyntheticTree(const TreeShape& shape, std::string root);
+
+    const TreeShape& shape() const { return treeShape; }
+    const std::string& root() const { return rootPath; }
+    uint64_t folderCount() const { return folders; }
+    uint64_t fileCount() const;
+
+    unsigned int foldersIn(uint64_t folder) const;
+    uint64_t filesIn(uint64_t folder) const;
+    uint64_t childFolder(uint64_t folder, unsigned int i) const { return folder * treeShape.fanout + 1 + i; }
+    std::string folderName(uint64_t folder, unsigned int i) const;
+    std::string fileName(uint64_t folder, uint64_t i) const;
+    // Log-uniform sizes up to 1 GiB, modified some time in the three years before the tree's base time
+    FileAttributes fileAttributes(uint64_t folder, uint64_t i) const;
+    // Full path of a folder, rebuilt from the root
+    std::string pathOf(uint64_t folder) const;
+
+    // Words the names are made of, most used first
+    const std::vector<std::string>& vocabulary() const { return words; }
+
+    // Serves the tree from memory, folders open by name like on a real disk
+    std::unique_ptr<FsBackend> backend() const;
+    // Writes the tree below root(), false on the first entry that can't be created
+    bool materialize() const;
+
+private:
+    std::string makeName(uint64_t folder, uint64_t i, bool isDir) const;
+    unsigned int depthOf(uint64_t folder) const;
+
+    TreeShape treeShape;
+    std::string rootPath;
+    uint64_t folders = 1;
+    uint64_t innerFolders = 0; // folders that have child folders
+    std::vector<std::string> words;
+};
+
+// The real file system, but a scan starts from roots instead of every drive
+std::unique_ptr<FsBackend> rootedBackend(std::vector<std::string> roots, bool listAttributes = false);
+
+#endif // TREEGEN_H
@@ -0,0 +1,12 @@
+QT       += core sql
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = vulture-cli
+
+include(../core/core.pri)
+
+SOURCES += \
+    main.cpp
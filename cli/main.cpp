@@ -0,0 +1,245 @@
+#include "drivewatcher.h"
+#include "fileindex.h"
+#include "indexer.h"
+#include "metrics.h"
+#include "querypattern.h"
+#include "searchengine.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+Drives the index without the search window, for scripts and measurements.
+Results go to stdout, timings and progress to stderr.
+*/
+
+namespace {
+
+const char* Usage =
+    "usage: vulture-cli [--data DIR] [--threads N] [--attributes] [--metrics FILE] [--trace FILE] COMMAND\n"
+    "\n"
+    "commands:\n"
+    "  index [--rescan]            load the stored index and catch up, or scan every drive\n"
+    "  query [--limit N] [--fuzzy] TEXT...\n"
+    "                              print the top matches of TEXT, --fuzzy matches abbreviations\n"
+    "                              TEXT with * or ? is a glob, TEXT starting with regex: a regex\n"
+    "                              ext:pdf type:folder size:>100M modified:<7d filter the matches\n"
+    "  watch                       keep the stored index in sync until interrupted\n"
+    "  stats                       print index size and memory\n"
+    "\n"
+    "DIR holds files.db and the snapshot, the current folder by default.\n"
+    "--attributes reads size and time of every file while scanning, for size: and modified:.\n"
+    "Outside Windows that costs a stat per file, without it only the watcher fills them in.\n"
+    "--metrics writes counters and latency histograms as JSON on exit, and every few seconds\n"
+    "while watching. --trace writes Chrome trace events (chrome://tracing, Perfetto) on exit.\n";
+
+using Clock = chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+volatile sig_atomic_t interrupted = 0;
+
+void onInterrupt(int) {
+    interrupted = 1;
+}
+
+const int MetricsIntervalMs = 5000;
+
+struct Options {
+    QString dataDir = QDir::currentPath();
+    unsigned int threads = 0;
+    bool attributes = false;
+    QString metricsFile;
+    QString traceFile;
+    QString command;
+    QStringList args;
+};
+
+bool parseOptions(const QStringList& arguments, Options& options) {
+    for (int i = 1; i < arguments.size(); ++i) {
+        const QString& arg = arguments[i];
+        if (options.command.isEmpty() && arg == "--data" && i + 1 < arguments.size()) {
+            options.dataDir = arguments[++i];
+        } else if (options.command.isEmpty() && arg == "--threads" && i + 1 < arguments.size()) {
+            options.threads = arguments[++i].toUInt();
+        } else if (options.command.isEmpty() && arg == "--attributes") {
+            options.attributes = true;
+        } else if (options.command.isEmpty() && arg == "--metrics" && i + 1 < arguments.size()) {
+            options.metricsFile = arguments[++i];
+        } else if (options.command.isEmpty() && arg == "--trace" && i + 1 < arguments.size()) {
+            options.traceFile = arguments[++i];
+        } else if (options.command.isEmpty()) {
+            if (arg.startsWith("--")) return false;
+            options.command = arg;
+        } else {
+            options.args.append(arg);
+        }
+    }
+    return !options.command.isEmpty();
+}
+
+// Loads without touching the file system, a missing index is an error here
+bool loadIndex(Indexer& indexer) {
+    Clock::time_point start = Clock::now();
+    Indexer::Source source = indexer.load();
+    if (source == Indexer::Source::None) {
+        cerr << "No stored index, run 'vulture-cli index' first" << endl;
+        return false;
+    }
+    cerr << "loaded from " << Indexer::sourceName(source) << " in " << msSince(start) << " ms" << endl;
+    return true;
+}
+
+int runIndex(FileIndex& index, Indexer& indexer, const Options& options) {
+    Clock::time_point start = Clock::now();
+    if (options.args.contains("--rescan")) {
+        indexer.scan();
+        cerr << "scanned";
+    } else {
+        cerr << "opened from " << Indexer::sourceName(indexer.open());
+    }
+    cerr << " in " << msSince(start) << " ms, " << index.size() << " entries" << endl;
+    return 0;
+}
+
+int runQuery(FileIndex& index, Indexer& indexer, const Options& options) {
+    size_t limit = 50;
+    bool fuzzy = false;
+    QStringList words;
+    for (int i = 0; i < options.args.size(); ++i) {
+        if (options.args[i] == "--limit" && i + 1 < options.args.size())
+            limit = options.args[++i].toULongLong();
+        else if (options.args[i] == "--fuzzy")
+            fuzzy = true;
+        else
+            words.append(options.args[i]);
+    }
+    if (words.isEmpty()) {
+        cerr << Usage;
+        return 2;
+    }
+    if (!loadIndex(indexer)) return 1;
+
+    SearchEngine engine(index);
+    engine.setFuzzy(fuzzy);
+    string text = words.join(' ').toStdString();
+    Clock::time_point start = Clock::now();
+    double firstBatchMs = -1;
+    vector<uint32_t> top;
+    engine.run(engine.start(), text, limit, [&](const vector<uint32_t>& ids, bool finished) {
+        if (firstBatchMs < 0) firstBatchMs = msSince(start);
+        if (finished) top = ids;
+    });
+    double totalMs = msSince(start);
+
+    string error = engine.lastError();
+    if (!error.empty()) {
+        cerr << "invalid query: " << error << endl;
+        return 2;
+    }
+    FileIndex::FilterStats filter = engine.lastFilter();
+    if (filter.candidates > 0 || QueryPattern(text).kind() != QueryPattern::Substring) {
+        cerr << filter.candidates << " candidates in " << filter.prefilterMs << " ms, " << filter.matches
+             << " matched in " << filter.verifyMs << " ms" << endl;
+    }
+
+    for (uint32_t id : top) {
+        string path = index.pathOf(id);
+        if (!path.empty()) cout << path << '\n';
+    }
+    cout.flush();
+    cerr << top.size() << " results, first batch " << max(firstBatchMs, 0.0) << " ms, ranked " << totalMs << " ms"
+         << endl;
+    return 0;
+}
+
+void writeMetrics(const Options& options) {
+    if (!options.metricsFile.isEmpty() && !Metrics::dump(options.metricsFile.toStdString()))
+        cerr << "Can't write " << options.metricsFile.toStdString() << endl;
+}
+
+int runWatch(FileIndex& index, Indexer& indexer, const IndexPaths& paths, const Options& options) {
+    cerr << "opened from " << Indexer::sourceName(indexer.open()) << ", " << index.size() << " entries" << endl;
+
+    DriveWatcher watcher(index, paths.database, paths.snapshot);
+    watcher.start();
+    watcher.startWriting();
+    signal(SIGINT, onInterrupt);
+    signal(SIGTERM, onInterrupt);
+
+    uint64_t reported = 0;
+    Clock::time_point lastDump = Clock::now();
+    while (!interrupted) {
+        this_thread::sleep_for(chrono::milliseconds(200));
+        if (msSince(lastDump) >= MetricsIntervalMs) {
+            writeMetrics(options);
+            lastDump = Clock::now();
+        }
+
+        IndexWriter::Stats stats = watcher.writerStats();
+        if (stats.changes == reported) continue;
+        reported = stats.changes;
+        cerr << stats.changes << " changes in " << stats.commits << " commits, average commit "
+             << stats.averageCommitMs() << " ms, slowest " << stats.maxCommitMs << " ms, "
+             << index.size() << " entries" << endl;
+    }
+
+    cerr << "stopping" << endl;
+    watcher.stop();
+    return 0;
+}
+
+int runStats(FileIndex& index, Indexer& indexer, const IndexPaths& paths) {
+    if (!loadIndex(indexer)) return 1;
+
+    cout << "entries      " << index.size() << '\n'
+         << "ids          " << index.endId() << '\n'
+         << "heap bytes   " << index.memoryUsage() << '\n'
+         << "files.db     " << QFileInfo(paths.database).size() << " bytes" << '\n';
+    cout.flush();
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("vulture-cli");
+
+    Options options;
+    if (!parseOptions(app.arguments(), options)) {
+        cerr << Usage;
+        return 2;
+    }
+
+    if (!options.traceFile.isEmpty()) TraceLog::enable();
+
+    IndexPaths paths = IndexPaths::in(options.dataDir);
+    FileIndex index;
+    Indexer indexer(index, paths, options.threads);
+    indexer.setListAttributes(options.attributes);
+
+    int status = 2;
+    if (options.command == "index") status = runIndex(index, indexer, options);
+    else if (options.command == "query") status = runQuery(index, indexer, options);
+    else if (options.command == "watch") status = runWatch(index, indexer, paths, options);
+    else if (options.command == "stats") status = runStats(index, indexer, paths);
+    else cerr << Usage;
+
+    writeMetrics(options);
+    if (!options.traceFile.isEmpty() && !TraceLog::write(options.traceFile.toStdString()))
+        cerr << "Can't write " << options.traceFile.toStdString() << endl;
+    return status;
+}
@@ -0,0 +1,95 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "mappedfile.h"
+
+/*
+An array that either owns its elements or reads them straight from a mapped
+snapshot. Reads never copy. The first write to a mapped column copies it to
+the heap once and drops the mapping, so only the parts of an index that
+actually change ever leave the page cache.
+*/
+template <typename T>
+class Column {
+public:
+    // Serves reads from count elements at data, file keeps the memory alive
+    void map(std::shared_ptr<MappedFile> file, const T* data, size_t count) {
+        std::vector<T>().swap(owned);
+        view = data;
+        viewSize = count;
+        keepAlive = std::move(file);
+    }
+
+    void adopt(std::vector<T>&& elements) {
+        dropView();
+        owned = std::move(elements);
+    }
+
+    bool isMapped() const { return view != nullptr; }
+    size_t size() const { return view ? viewSize : owned.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T* data() const { return view ? view : owned.data(); }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+    const T& operator[](size_t i) const { return data()[i]; }
+    const T& back() const { return data()[size() - 1]; }
+
+    T& operator[](size_t i) {
+        own();
+        return owned[i];
+    }
+
+    void push_back(const T& value) {
+        own();
+        owned.push_back(value);
+    }
+
+    template <typename It>
+    void append(It first, It last) {
+        own();
+        owned.insert(owned.end(), first, last);
+    }
+
+    void assign(size_t count, const T& value) {
+        dropView();
+        owned.assign(count, value);
+    }
+
+    void resize(size_t count) {
+        own();
+        owned.resize(count);
+    }
+
+    void clear() {
+        dropView();
+        owned.clear();
+    }
+
+    // Heap elements only, a mapped column costs nothing here
+    size_t capacity() const { return owned.capacity(); }
+
+private:
+    void own() {
+        if (!view) return;
+        owned.assign(view, view + viewSize);
+        dropView();
+    }
+
+    void dropView() {
+        view = nullptr;
+        viewSize = 0;
+        keepAlive.reset();
+    }
+
+    std::vector<T> owned;
+    const T* view = nullptr;
+    size_t viewSize = 0;
+    std::shared_ptr<MappedFile> keepAlive;
+};
+
+#endif // COLUMN_H
@@ -0,0 +1,13 @@
+# Links the static core library, included by every project that uses it
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+QT += sql
+
+win32:CONFIG(release, debug|release): CORE_DIR = $$OUT_PWD/../core/release
+else:win32:CONFIG(debug, debug|release): CORE_DIR = $$OUT_PWD/../core/debug
+else: CORE_DIR = $$OUT_PWD/../core
+
+LIBS += -L$$CORE_DIR -lvulturecore
+win32-g++: PRE_TARGETDEPS += $$CORE_DIR/libvulturecore.a
+else:win32: PRE_TARGETDEPS += $$CORE_DIR/vulturecore.lib
+else: PRE_TARGETDEPS += $$CORE_DIR/libvulturecore.a
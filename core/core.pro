@@ -0,0 +1,59 @@
+QT       += core sql
+QT       -= gui
+
+TEMPLATE = lib
+CONFIG += staticlib c++17
+
+TARGET = vulturecore
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../attributes.cpp \
+    ../drivewatcher.cpp \
+    ../eventcoalescer.cpp \
+    ../fileindex.cpp \
+    ../fsbackend.cpp \
+    ../fswatcher.cpp \
+    ../fuzzymatch.cpp \
+    ../indexer.cpp \
+    ../indexsnapshot.cpp \
+    ../indexstore.cpp \
+    ../indexwriter.cpp \
+    ../itembulkloader.cpp \
+    ../mappedfile.cpp \
+    ../metrics.cpp \
+    ../pendingcreates.cpp \
+    ../querypattern.cpp \
+    ../querysession.cpp \
+    ../ranking.cpp \
+    ../reconciler.cpp \
+    ../searchengine.cpp \
+    ../simdsearch.cpp \
+    ../trigramindex.cpp
+
+HEADERS += \
+    ../attributes.h \
+    ../boundedqueue.h \
+    ../column.h \
+    ../drivewatcher.h \
+    ../eventcoalescer.h \
+    ../fileindex.h \
+    ../fsbackend.h \
+    ../fswatcher.h \
+    ../fuzzymatch.h \
+    ../indexer.h \
+    ../indexsnapshot.h \
+    ../indexstore.h \
+    ../indexwriter.h \
+    ../itembulkloader.h \
+    ../mappedfile.h \
+    ../metrics.h \
+    ../pendingcreates.h \
+    ../querypattern.h \
+    ../querysession.h \
+    ../ranking.h \
+    ../reconciler.h \
+    ../searchengine.h \
+    ../simdsearch.h \
+    ../trigramindex.h \
+    ../workstealing.h
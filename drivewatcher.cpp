@@ -1,234 +1,239 @@
-#include <windows.h>
-#include <QString>
-#include <QSqlDatabase>
-#include <QSqlQuery>
-#include <QDir>
-#include <QSqlError>
+#include "drivewatcher.h"
+#include "fileindex.h"
+#include "fsbackend.h"
+#include "indexer.h"
+#include "metrics.h"
+#include "reconciler.h"
 #include <QDebug>
-#include <QFileInfo>
-#include <QDateTime>
-#include <QTimer>
-#include <thread>
-#include <vector>
-#include <map>
-#include <mutex>
-#include <chrono>
+#include <algorithm>
 using namespace std;
 
-enum class FileStatus { Created, Deleted, Renamed };
+namespace {
 
-struct FileChange {
-    wstring path;
-    FileStatus status;
-    QChar type;
-    QDateTime timestamp;
-};
+// Lost events were at most this much older than the last batch that arrived complete
+const int64_t ResyncSlack = 5 * DirStamp::TicksPerSecond;
+const unsigned int ResyncThreads = 2;
 
-mutex g_mutex;
-vector<FileChange> g_pendingInserts;
+// True for folder itself and everything inside it
+bool IsSameOrBelow(const string& path, const string& folder) {
+    if (path.compare(0, folder.size(), folder) != 0) return false;
+    return path.size() == folder.size() || folder.back() == FileIndex::Separator
+           || path[folder.size()] == FileIndex::Separator;
+}
 
-wstring GetFileName(const FILE_NOTIFY_INFORMATION* fni) {
-    return wstring(fni->FileName, fni->FileNameLength / sizeof(WCHAR));
 }
 
-// Get all system drives
-vector<wstring> GetAllDrives() {
-    DWORD driveMask = GetLogicalDrives();
-    vector<wstring> drives;
-    for (int i = 0; i < 26; ++i) {
-        if (driveMask & (1 << i)) {
-            wchar_t letter = L'A' + i;
-            wstring driveRoot = wstring(1, letter) + L":\\";
-            if (GetDriveType(driveRoot.c_str()) != DRIVE_REMOVABLE) 
-                drives.push_back(driveRoot);
-        }
-    }
-    return drives;
+DriveWatcher::DriveWatcher(FileIndex& index, const QString& databasePath, const QString& snapshotPath)
+    : index(index), writer(index, databasePath, snapshotPath), pending(FileIndex::Separator, CreateDelay) {}
+
+DriveWatcher::~DriveWatcher() {
+    stop();
 }
 
-// Determine if path is file or directory
-QChar DetectFileType(const wstring& path) {
-    DWORD attr = GetFileAttributesW(path.c_str());
-    if (attr == INVALID_FILE_ATTRIBUTES)
-        return '?';
-    return (attr & FILE_ATTRIBUTE_DIRECTORY) ? 'd' : 'f';
+void DriveWatcher::start() {
+    if (watchThread.joinable()) return;
+    stopping = false;
+    insertThread = thread(&DriveWatcher::insertLoop, this);
+    resyncThread = thread(&DriveWatcher::resyncLoop, this);
+    watchThread = thread(&DriveWatcher::watchLoop, this);
 }
 
-// Insert queued "created" items into DB after delay
-void StartInsertWorker(const QString& connName) {
-    thread([connName]() {
-        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
-        db.setDatabaseName(QDir::currentPath() + "/files.db");
+void DriveWatcher::startWriting() {
+    writer.start();
+    lock_guard<mutex> lock(resyncLock);
+    writing = true;
+    resyncRequested.notify_all();
+}
 
-        if (!db.open()) {
-            qWarning() << "InsertWorker DB open failed:" << db.lastError().text();
-            return;
-        }
+void DriveWatcher::stop() {
+    if (!watchThread.joinable()) return;
 
-        QSqlQuery query(db);
+    stopping = true;
+    {
+        lock_guard<mutex> lock(watcherLock);
+        if (watcher) watcher->stop();
+    }
+    // Taking each lock once makes sure the loops either see stopping or are already waiting
+    { lock_guard<mutex> lock(pendingLock); }
+    pendingAdded.notify_all();
+    { lock_guard<mutex> lock(resyncLock); }
+    resyncRequested.notify_all();
+
+    watchThread.join();
+    insertThread.join();
+    resyncThread.join();
+    // Creates still waiting out their delay are dropped, the next start reconciles them
+    writer.stop();
+}
 
-        while (true) {
-            this_thread::sleep_for(chrono::milliseconds(500));
+// Queues a resync, one that covers another takes it over
+void DriveWatcher::requestResync(const string& path, int64_t since) {
+    lock_guard<mutex> lock(resyncLock);
+    for (Resync& queued : resyncs) {
+        if (IsSameOrBelow(path, queued.path)) {
+            queued.since = min(queued.since, since);
+            return;
+        }
+    }
 
-            vector<FileChange> toInsert;
+    auto covered = [&](const Resync& queued) {
+        if (!IsSameOrBelow(queued.path, path)) return false;
+        since = min(since, queued.since);
+        return true;
+    };
+    resyncs.erase(remove_if(resyncs.begin(), resyncs.end(), covered), resyncs.end());
+    resyncs.push_back({ path, since });
+    resyncRequested.notify_one();
+}
 
-            {
-                lock_guard<mutex> lock(g_mutex);
-                QDateTime now = QDateTime::currentDateTime();
-
-                auto it = g_pendingInserts.begin();
-                while (it != g_pendingInserts.end()) {
-                    /*
-                    Assume user has just created a folder , before pushing the folder path to db,
-                    it waits for 15 seconds, user can change the folder name during this period.
-                    */
-                    if (it->timestamp.msecsTo(now) >= 15000) {
-                        toInsert.push_back(*it);
-                        it = g_pendingInserts.erase(it);
-                    } else {
-                        ++it;
-                    }
-                }
-            }
+/*
+Brings one subtree back in line after an overflow, one subtree at a time.
+Only folders modified since the events were lost are listed, the rest are
+just walked, so a burst in one folder does not cost a rescan of the drive.
+*/
+void DriveWatcher::resyncLoop() {
+    unique_ptr<FsBackend> backend = FsBackend::create();
 
-            for (const FileChange& change : toInsert) {
-                QString path = QString::fromStdWString(change.path);
-                QString type = QString(change.type);
+    while (true) {
+        Resync resync;
+        {
+            unique_lock<mutex> lock(resyncLock);
+            resyncRequested.wait(lock, [this] { return stopping || (writing && !resyncs.empty()); });
+            if (stopping) return;
+            resync = move(resyncs.front());
+            resyncs.erase(resyncs.begin());
+        }
 
-                query.prepare("INSERT OR REPLACE INTO items (path, type) VALUES (:path, :type)");
-                query.bindValue(":path", path);
-                query.bindValue(":type", type);
+        Metrics::counter("watcher.resyncs").add();
+        Reconciler::Changes changes;
+        {
+            ScopedTimer timer(Metrics::histogram("watcher.resync"), "watcher resync");
+            Reconciler reconciler(index, *backend, getPriorityFromPath);
+            reconciler.setChangedSince(resync.since);
+            changes = reconciler.run(ResyncThreads, { resync.path });
+        }
 
-                if (!query.exec()) {
-                    qWarning() << "Delayed Insert Failed:" << query.lastError().text();
-                }
-            }
+        for (uint32_t id : changes.removed) {
+            string path = index.pathOf(id);
+            if (!path.empty())
+                writer.submit({ FileIndex::Change::Remove, move(path), {}, index.typeOf(id) });
+        }
+        for (Reconciler::Added& item : changes.added)
+            writer.submit({ FileIndex::Change::Add, move(item.path), {}, item.type, item.priority, item.attributes });
+        // After the adds, so a folder that was just added gets its stamp too
+        for (auto& folder : changes.stamps) {
+            FileIndex::Change stamp;
+            stamp.kind = FileIndex::Change::Stamp;
+            stamp.path = move(folder.first);
+            stamp.stamp = folder.second;
+            writer.submit(move(stamp));
         }
 
-        db.close();
-        QSqlDatabase::removeDatabase(connName);
-    }).detach();
+        qDebug() << "Resynced" << QString::fromStdString(resync.path) << "- listed" << changes.listed << "of"
+                 << changes.checked << "folders," << changes.added.size() << "added,"
+                 << changes.removed.size() << "removed";
+    }
 }
 
-// Monitor a single drive for changes
-void MonitorDrive(const wstring& rootPath) {
-    HANDLE hDir = CreateFileW(
-        rootPath.c_str(),
-        FILE_LIST_DIRECTORY,
-        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-        nullptr,
-        OPEN_EXISTING,
-        FILE_FLAG_BACKUP_SEMANTICS,
-        nullptr
-        );
-
-    if (hDir == INVALID_HANDLE_VALUE) {
-        qWarning() << "Failed to open directory handle for" << QString::fromStdWString(rootPath);
-        return;
+// Hands creates to the writer once their delay is over
+void DriveWatcher::insertLoop() {
+    static Gauge& backlog = Metrics::gauge("watcher.pending_creates");
+    unique_ptr<FsBackend> backend = FsBackend::create();
+    unique_lock<mutex> lock(pendingLock);
+    while (!stopping) {
+        // Later creates are never due before the oldest one, so only an empty queue needs a wake-up
+        PendingCreates::Clock::time_point due;
+        if (pending.nextDeadline(due))
+            pendingAdded.wait_until(lock, due);
+        else
+            pendingAdded.wait(lock);
+        if (stopping) break;
+
+        vector<PendingCreates::Ready> ready = pending.takeDue();
+        if (ready.empty()) continue;
+        backlog.set(int64_t(pending.size()));
+
+        // The event has no size or time, a file that is already gone again keeps none
+        lock.unlock();
+        for (PendingCreates::Ready& create : ready) {
+            FileAttributes attributes;
+            if (create.type != 'd')
+                backend->attributesOf(create.path, attributes);
+            writer.submit({ FileIndex::Change::Add, move(create.path), {}, create.type, 0, attributes });
+        }
+        lock.lock();
     }
+}
 
-    QString connName = "Watcher_" + QString::number((quintptr)GetCurrentThreadId());
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
-    db.setDatabaseName(QDir::currentPath() + "/files.db");
+// Turns one coalesced batch into index changes, creates wait in pending first
+void DriveWatcher::applyBatch(const vector<FsEvent>& batch, int64_t syncedSince) {
+    static Gauge& backlog = Metrics::gauge("watcher.pending_creates");
+    for (const FsEvent& event : batch) {
+        switch (event.kind) {
+        case FsEvent::Created: {
+            lock_guard<mutex> lock(pendingLock);
+            bool wasEmpty = pending.empty();
+            pending.add(event.path, event.isDir ? 'd' : 'f');
+            backlog.set(int64_t(pending.size()));
+            if (wasEmpty) pendingAdded.notify_one();
+            break;
+        }
 
-    if (!db.open()) {
-        qWarning() << "Failed to open DB in MonitorDrive:" << db.lastError().text();
-        return;
-    }
+        case FsEvent::Deleted: {
+            {
+                lock_guard<mutex> lock(pendingLock);
+                pending.remove(event.path);
+                backlog.set(int64_t(pending.size()));
+            }
+            writer.submit({ FileIndex::Change::Remove, event.path, {}, event.isDir ? 'd' : 'f' });
+            break;
+        }
 
-    QSqlQuery query(db);
-    char buffer[8192];
-    DWORD bytesReturned;
+        case FsEvent::Renamed: {
+            // Creates still waiting out their delay simply land under the new name
+            bool stillPending = false;
+            {
+                lock_guard<mutex> lock(pendingLock);
+                stillPending = pending.rename(event.oldPath, event.path);
+            }
+            if (!stillPending)
+                writer.submit({ FileIndex::Change::Rename, event.path, event.oldPath, event.isDir ? 'd' : 'f' });
+            break;
+        }
 
-    while (true) {
-        if (ReadDirectoryChangesW(
-                hDir,
-                buffer,
-                sizeof(buffer),
-                TRUE,
-                FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME,
-                &bytesReturned,
-                nullptr,
-                nullptr)) {
-
-            FILE_NOTIFY_INFORMATION* fni = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(buffer);
-            wstring oldName;
-
-            do {
-                wstring relative = GetFileName(fni);
-                wstring fullPath = rootPath + relative;
-                FileChange change;
-
-                switch (fni->Action) {
-                case FILE_ACTION_ADDED:
-                    change = {
-                        fullPath,
-                        FileStatus::Created,
-                        DetectFileType(fullPath),
-                        QDateTime::currentDateTime()
-                    };
-
-                    {
-                        lock_guard<mutex> lock(g_mutex);
-                        g_pendingInserts.push_back(change);
-                    }
-                    break;
-
-                case FILE_ACTION_REMOVED:
-                    query.prepare("DELETE FROM items WHERE path = :path");
-                    query.bindValue(":path", QString::fromStdWString(fullPath));
-                    if (!query.exec())
-                        qWarning() << "Delete failed:" << query.lastError().text();
-                    break;
-
-                case FILE_ACTION_RENAMED_OLD_NAME:
-                    oldName = fullPath;
-                    break;
-
-                case FILE_ACTION_RENAMED_NEW_NAME:
-                    // Remove old name
-                    query.prepare("DELETE FROM items WHERE path = :path");
-                    query.bindValue(":path", QString::fromStdWString(oldName));
-                    if (!query.exec())
-                        qWarning() << "Rename delete failed:" << query.lastError().text();
-
-                    // Insert new name immediately
-                    query.prepare("INSERT OR REPLACE INTO items (path, type) VALUES (:path, :type)");
-                    query.bindValue(":path", QString::fromStdWString(fullPath));
-                    query.bindValue(":type", QString(DetectFileType(fullPath)));
-                    if (!query.exec())
-                        qWarning() << "Rename insert failed:" << query.lastError().text();
-                    break;
-
-                default:
-                    break;
-                }
-
-                if (fni->NextEntryOffset == 0)
-                    break;
-
-                fni = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(
-                    reinterpret_cast<BYTE*>(fni) + fni->NextEntryOffset
-                    );
-
-            } while (true);
-
-        } else {
-            qWarning() << "ReadDirectoryChangesW failed. Exiting thread.";
+        case FsEvent::Overflow:
+            qWarning() << "File system events were lost below" << QString::fromStdString(event.path)
+                       << "- resyncing it";
+            requestResync(event.path, syncedSince - ResyncSlack);
             break;
         }
     }
-
-    CloseHandle(hDir);
-    db.close();
-    QSqlDatabase::removeDatabase(connName);
 }
 
-void DriveWatch() {
-    auto drives = GetAllDrives();
-    StartInsertWorker("InsertWorker");
+void DriveWatcher::watchLoop() {
+    unique_ptr<FsBackend> backend = FsBackend::create();
+    int64_t syncedSince = backend->now();
 
-    for (const auto& drive : drives) {
-        thread(MonitorDrive, drive).detach();
+    // Setting up can take a while (inotify walks the tree), stop() must not miss the result
+    unique_ptr<FsWatcher> created = FsWatcher::create(backend->roots());
+    if (!created) {
+        qWarning() << "No file system watcher available, the index only changes on a scan";
+        return;
     }
+    if (!created->warning().empty())
+        qWarning() << created->name() << "watcher:" << QString::fromStdString(created->warning());
+
+    FsWatcher* active = created.get();
+    {
+        lock_guard<mutex> lock(watcherLock);
+        if (stopping) return;
+        watcher = move(created);
+    }
+
+    // Whatever a batch lost happened after the previous batch was taken
+    active->run([&](vector<FsEvent>& batch) {
+        int64_t taken = backend->now();
+        applyBatch(batch, syncedSince);
+        syncedSince = taken;
+    });
 }
@@ -1,6 +1,79 @@
 #ifndef DRIVEWATCHER_H
 #define DRIVEWATCHER_H
 
-void DriveWatch();
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "fswatcher.h"
+#include "indexwriter.h"
+#include "pendingcreates.h"
+
+class FileIndex;
+
+/*
+Keeps files.db and the in-memory index in sync with file system changes.
+Creates wait CreateDelay before they are written, a folder that is renamed
+right after it was created only reaches the index under its final name.
+Lost events make the affected subtree resync on a thread of its own.
+Nothing is written before startWriting(): the Indexer writes files.db on
+its own connection while it loads, changes seen meanwhile queue up and are
+applied after it committed.
+*/
+class DriveWatcher {
+public:
+    static constexpr std::chrono::seconds CreateDelay{ 15 };
+
+    DriveWatcher(FileIndex& index, const QString& databasePath, const QString& snapshotPath);
+    // Stops the threads, changes already queued are still written
+    ~DriveWatcher();
+
+    // Starts watching, changes queue up until startWriting()
+    void start();
+    // Call once the index was loaded
+    void startWriting();
+    void stop();
+
+    IndexWriter::Stats writerStats() const { return writer.stats(); }
+
+private:
+    // A subtree to resync after the watcher lost events below it
+    struct Resync {
+        std::string path;
+        int64_t since; // folders last modified before this, in stamp time, kept their entries
+    };
+
+    void watchLoop();
+    void insertLoop();
+    void resyncLoop();
+    void applyBatch(const std::vector<FsEvent>& batch, int64_t syncedSince);
+    void requestResync(const std::string& path, int64_t since);
+
+    FileIndex& index;
+    IndexWriter writer;
+    std::atomic<bool> stopping{ false };
+    bool writing = false; // guarded by resyncLock, a resync reads the index so it waits for the load too
+
+    std::mutex pendingLock;
+    std::condition_variable pendingAdded;
+    PendingCreates pending;
+
+    std::mutex resyncLock;
+    std::condition_variable resyncRequested;
+    std::vector<Resync> resyncs;
+
+    std::mutex watcherLock; // stop() may come while the watcher is still being set up
+    std::unique_ptr<FsWatcher> watcher;
+
+    std::thread watchThread;
+    std::thread insertThread;
+    std::thread resyncThread;
+};
 
 #endif // DRIVEWATCHER_H
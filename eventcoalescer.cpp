@@ -0,0 +1,88 @@
+#include "eventcoalescer.h"
+
+using namespace std;
+
+EventCoalescer::EventCoalescer(char separator) : separator(separator) {}
+
+void EventCoalescer::drop(size_t index) {
+    if (dropped[index]) return;
+    dropped[index] = true;
+    --pending;
+}
+
+// Drops the events recorded in byPath for entries inside folder
+void EventCoalescer::dropBelow(map<string, size_t>& byPath, const string& folder) {
+    string prefix = folder;
+    if (prefix.empty() || prefix.back() != separator)
+        prefix += separator;
+
+    auto it = byPath.lower_bound(prefix);
+    while (it != byPath.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        drop(it->second);
+        it = byPath.erase(it);
+    }
+}
+
+void EventCoalescer::add(FsEvent event) {
+    switch (event.kind) {
+    case FsEvent::Created:
+        if (created.count(event.path)) return;
+        deleted.erase(event.path);
+        created[event.path] = events.size();
+        break;
+
+    case FsEvent::Deleted: {
+        auto it = created.find(event.path);
+        if (it != created.end()) {
+            // Created and gone within the burst, the index never needs to see it
+            drop(it->second);
+            created.erase(it);
+            if (event.isDir) dropBelow(created, event.path);
+            return;
+        }
+        if (event.isDir) {
+            dropBelow(created, event.path);
+            dropBelow(deleted, event.path);
+        }
+        deleted[event.path] = events.size();
+        break;
+    }
+
+    case FsEvent::Renamed: {
+        auto it = created.find(event.oldPath);
+        if (it != created.end() && !event.isDir) {
+            // Still pending as a create, so create it under the new name instead
+            events[it->second].path = event.path;
+            created[event.path] = it->second;
+            created.erase(it);
+            return;
+        }
+        created.erase(event.path);
+        deleted.erase(event.path);
+        break;
+    }
+
+    case FsEvent::Overflow:
+        break;
+    }
+
+    events.push_back(move(event));
+    dropped.push_back(false);
+    ++pending;
+}
+
+vector<FsEvent> EventCoalescer::take() {
+    vector<FsEvent> out;
+    out.reserve(pending);
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (!dropped[i])
+            out.push_back(move(events[i]));
+    }
+
+    events.clear();
+    dropped.clear();
+    created.clear();
+    deleted.clear();
+    pending = 0;
+    return out;
+}
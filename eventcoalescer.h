@@ -0,0 +1,53 @@
+#ifndef EVENTCOALESCER_H
+#define EVENTCOALESCER_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+// One normalized file system change, paths are absolute and UTF-8
+struct FsEvent {
+    enum Kind {
+        Created,
+        Deleted,
+        Renamed,
+        Overflow // the watcher lost events below path, it has to be rescanned
+    };
+
+    Kind kind;
+    std::string path;
+    std::string oldPath; // Renamed only
+    bool isDir = false;
+};
+
+/*
+Collects the events of one burst and drops the ones that cancel out:
+an entry created and deleted again never shows up, repeated creates count
+once, and a folder delete swallows the deletes and creates below it that
+came before it. What is left keeps its original order.
+*/
+class EventCoalescer {
+public:
+    explicit EventCoalescer(char separator);
+
+    void add(FsEvent event);
+    // Everything since the last take, the coalescer starts empty again
+    std::vector<FsEvent> take();
+
+    size_t size() const { return pending; }
+    bool empty() const { return pending == 0; }
+
+private:
+    void drop(size_t index);
+    void dropBelow(std::map<std::string, size_t>& byPath, const std::string& folder);
+
+    char separator;
+    std::vector<FsEvent> events;
+    std::vector<bool> dropped;
+    std::map<std::string, size_t> created; // path -> event, for creates still in this burst
+    std::map<std::string, size_t> deleted;
+    size_t pending = 0;
+};
+
+#endif // EVENTCOALESCER_H
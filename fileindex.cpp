@@ -0,0 +1,1353 @@
+#include "fileindex.h"
+#include "fuzzymatch.h"
+#include "metrics.h"
+#include "simdsearch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+const uint32_t EmptySlot = UINT32_MAX;
+const uint32_t ErasedSlot = UINT32_MAX - 1;
+
+enum SnapshotSection : uint32_t {
+    MetaSection = 1,
+    EntrySection,
+    NameSection,
+    FoldedSection,
+    RecordSection,
+    TableSection,
+    StampSection,
+    TrigramListSection,
+    TrigramByteSection,
+    RankSection,
+    CharMaskSection,
+    SizeSection,
+    TimeSection,
+    ExtensionSection,
+    ExtensionNameSection,
+    ChildSection,
+    SiblingSection
+};
+
+const uint16_t OverflowExtension = UINT16_MAX; // shared by every extension past the first 65534
+
+struct SnapshotMeta {
+    uint64_t liveCount;
+    uint64_t tableUsed;
+    uint64_t renameCount;
+    uint32_t trigramEnd;
+    uint32_t entrySize; // guards against a snapshot written by a build with another Entry layout
+};
+
+// Element count of a mapped section, false when it is missing or not a whole number of elements
+template <typename T>
+bool sectionOf(const SnapshotReader& reader, uint32_t id, const T*& data, size_t& count) {
+    const void* raw = nullptr;
+    size_t bytes = 0;
+    if (!reader.section(id, raw, bytes) || bytes % sizeof(T) != 0) return false;
+    data = static_cast<const T*>(raw);
+    count = bytes / sizeof(T);
+    return true;
+}
+
+/*
+Lower case of a letter whose lower case takes as many UTF-8 bytes, anything
+else as is, so a folded name lines up byte for byte with the original.
+Covers Latin-1, Latin Extended-A, Greek, Cyrillic, Armenian, Latin Extended
+Additional and fullwidth Latin. Letters whose lower case is longer or
+shorter (the Kelvin sign, dotted capital I, capital sharp s) keep their case.
+*/
+uint32_t lowerOf(uint32_t c) {
+    if (c < 0x80) return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 0x20;
+    if (c >= 0x100 && c <= 0x17F) {
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149 || c == 0x17F) return c;
+        if (c == 0x178) return 0xFF;
+        // Pairs start on an even code point, except in 0139-0148 and 0179-017E
+        bool evenUpper = c < 0x139 || (c >= 0x14A && c < 0x178);
+        return ((c & 1) == 0) == evenUpper ? c + 1 : c;
+    }
+    if (c >= 0x391 && c <= 0x3AB && c != 0x3A2) return c + 0x20;
+    if (c == 0x386) return 0x3AC;
+    if (c >= 0x388 && c <= 0x38A) return c + 0x25;
+    if (c == 0x38C) return 0x3CC;
+    if (c == 0x38E || c == 0x38F) return c + 0x3F;
+    if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+    if (c >= 0x410 && c <= 0x42F) return c + 0x20;
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || (c >= 0x4D0 && c <= 0x52F)) return c | 1;
+    if (c == 0x4C0) return 0x4CF;
+    if (c >= 0x4C1 && c <= 0x4CE) return (c & 1) ? c + 1 : c;
+    if (c >= 0x531 && c <= 0x556) return c + 0x30;
+    if ((c >= 0x1E00 && c <= 0x1E95) || (c >= 0x1EA0 && c <= 0x1EFF)) return c | 1;
+    if (c >= 0xFF21 && c <= 0xFF3A) return c + 0x20;
+    return c;
+}
+
+// Writes text.size() folded bytes to out, malformed UTF-8 is copied unchanged
+void foldInto(string_view text, char* out) {
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        if (lead < 0x80) {
+            out[i++] = char(lowerOf(lead));
+            continue;
+        }
+
+        size_t length = (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : 1;
+        bool wellFormed = length > 1 && i + length <= text.size();
+        for (size_t k = 1; wellFormed && k < length; ++k)
+            wellFormed = (static_cast<unsigned char>(text[i + k]) & 0xC0) == 0x80;
+        if (!wellFormed) {
+            out[i++] = char(lead);
+            continue;
+        }
+
+        uint32_t c = lead & (length == 2 ? 0x1F : 0x0F);
+        for (size_t k = 1; k < length; ++k)
+            c = (c << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3F);
+        c = lowerOf(c);
+        if (length == 2) {
+            out[i] = char(0xC0 | (c >> 6));
+        } else {
+            out[i] = char(0xE0 | (c >> 12));
+            out[i + 1] = char(0x80 | ((c >> 6) & 0x3F));
+        }
+        out[i + length - 1] = char(0x80 | (c & 0x3F));
+        i += length;
+    }
+}
+
+// Takes the lock guard was made with and records how long that took
+template <typename Guard>
+void lockTimed(Guard& guard, Histogram& waits) {
+    auto start = chrono::steady_clock::now();
+    guard.lock();
+    waits.record(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+}
+
+// Windows paths are case-insensitive, so lookups compare folded names there
+inline bool sameName(string_view a, string_view b) {
+#if defined(_WIN32) || defined(_WIN64)
+    if (a.size() != b.size()) return false;
+    string foldedA(a), foldedB(b);
+    FileIndex::foldCase(foldedA);
+    FileIndex::foldCase(foldedB);
+    return foldedA == foldedB;
+#else
+    return a == b;
+#endif
+}
+
+inline bool isSeparator(char c) {
+#if defined(_WIN32) || defined(_WIN64)
+    return c == '\\' || c == '/';
+#else
+    return c == '/';
+#endif
+}
+
+}
+
+// Hands matches to SearchControl::partial in batches and remembers a cancellation
+class FileIndex::Progress {
+public:
+    explicit Progress(const SearchControl* control) : control(control) {}
+
+    bool cancelled() {
+        if (stopped.load(memory_order_relaxed)) return true;
+        if (control && control->cancelled && control->cancelled()) {
+            stopped = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool wasCancelled() const { return stopped.load(memory_order_relaxed); }
+
+    void found(vector<uint32_t>& pending, uint32_t id) {
+        if (!control || !control->partial) return;
+        pending.push_back(id);
+        if (pending.size() >= control->batchSize)
+            flush(pending);
+    }
+
+    // Scan threads share one callback, batches are delivered one at a time
+    void flush(vector<uint32_t>& pending) {
+        if (pending.empty() || wasCancelled()) return;
+        {
+            lock_guard<mutex> guard(deliver);
+            control->partial(pending);
+        }
+        pending.clear();
+    }
+
+private:
+    const SearchControl* control;
+    atomic<bool> stopped{false};
+    mutex deliver;
+};
+
+FileIndex::FileIndex() {
+    rehash(1024);
+    resetExtensions();
+}
+
+void FileIndex::foldCase(string& text) {
+    foldInto(text, &text[0]);
+}
+
+vector<string_view> FileIndex::splitPath(const string& path) {
+    vector<string_view> parts;
+    string_view view(path);
+
+    // POSIX root is an entry with an empty name
+    if (!view.empty() && view[0] == '/')
+        parts.push_back(string_view());
+
+    size_t i = 0;
+    while (i < view.size()) {
+        while (i < view.size() && isSeparator(view[i])) ++i;
+        size_t start = i;
+        while (i < view.size() && !isSeparator(view[i])) ++i;
+        if (i > start) parts.push_back(view.substr(start, i - start));
+    }
+    return parts;
+}
+
+uint64_t FileIndex::hashKey(uint32_t parent, string_view name) {
+    uint64_t h = 1469598103934665603ULL ^ (uint64_t(parent) * 0x9E3779B97F4A7C15ULL);
+#if defined(_WIN32) || defined(_WIN64)
+    string key(name);
+    foldCase(key);
+    name = key;
+#endif
+    for (char c : name) {
+        h ^= uint8_t(c);
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+uint64_t FileIndex::hashOf(const Entry& e) const {
+    return hashKey(e.parent, nameView(e));
+}
+
+void FileIndex::tableInsert(uint32_t id) {
+    // Growing re-inserts every live entry, this one included
+    if ((tableUsed + 1) * 2 > table.size()) {
+        rehash(table.size() * 2);
+        return;
+    }
+
+    size_t mask = table.size() - 1;
+    size_t slot = hashOf(entries[id]) & mask;
+    while (table[slot] != EmptySlot && table[slot] != ErasedSlot)
+        slot = (slot + 1) & mask;
+
+    if (table[slot] == EmptySlot) ++tableUsed;
+    table[slot] = id;
+}
+
+void FileIndex::tableErase(uint32_t id) {
+    size_t mask = table.size() - 1;
+    size_t slot = hashOf(entries[id]) & mask;
+    while (table[slot] != EmptySlot) {
+        if (table[slot] == id) {
+            table[slot] = ErasedSlot;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void FileIndex::rehash(size_t capacity) {
+    size_t needed = 1024;
+    while (needed < capacity) needed <<= 1;
+
+    table.assign(needed, EmptySlot);
+    tableUsed = 0;
+
+    // Children of removed folders are unreachable, drop them from the table
+    for (uint32_t id = 0; id < entries.size(); ++id) {
+        if (!isAlive(id)) continue;
+        size_t slot = hashOf(entries[id]) & (needed - 1);
+        while (table[slot] != EmptySlot)
+            slot = (slot + 1) & (needed - 1);
+        table[slot] = id;
+        ++tableUsed;
+    }
+}
+
+uint32_t FileIndex::childOf(uint32_t parent, string_view name) const {
+    size_t mask = table.size() - 1;
+    size_t slot = hashKey(parent, name) & mask;
+    while (table[slot] != EmptySlot) {
+        uint32_t id = table[slot];
+        if (id != ErasedSlot) {
+            const Entry& e = entries[id];
+            if (e.parent == parent && !(e.flags & DeletedFlag) && sameName(nameView(e), name))
+                return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NoParent;
+}
+
+bool FileIndex::isAlive(uint32_t id) const {
+    while (id != NoParent) {
+        const Entry& e = entries[id];
+        if (e.flags & DeletedFlag) return false;
+        id = e.parent;
+    }
+    return true;
+}
+
+uint32_t FileIndex::appendName(string_view name, uint32_t id) {
+    uint32_t offset = uint32_t(names.size());
+    records.push_back({ offset, id });
+    names.append(name.begin(), name.end());
+    names.push_back('\0');
+    size_t foldedAt = folded.size();
+    folded.resize(foldedAt + name.size() + 1);
+    foldInto(name, &folded[foldedAt]);
+    folded[foldedAt + name.size()] = '\0';
+    return offset;
+}
+
+uint32_t FileIndex::createEntry(uint32_t parent, string_view name, uint8_t flags, int priority,
+                                const FileAttributes& attributes) {
+    uint32_t id = uint32_t(entries.size());
+
+    Entry e;
+    e.nameOffset = appendName(name, id);
+    e.nameLength = uint16_t(min<size_t>(name.size(), UINT16_MAX));
+    e.parent = parent;
+    e.flags = flags;
+    e.priority = int8_t(priority);
+    entries.push_back(e);
+    firstChild.push_back(NoParent);
+    nextSibling.push_back(NoParent);
+    linkChild(parent, id);
+    ranks.push_back(rankOf(parent, name, flags & DirFlag));
+    charMasks.push_back(FuzzyMatch::charMask(foldedView(e)));
+    uint32_t size = attributes.known() ? Attributes::packSize(attributes.size) : Attributes::UnknownSize;
+    sizes.push_back((flags & DirFlag) ? 0 : size);
+    mtimes.push_back(Attributes::unixTime(attributes.mtime));
+    extensions.push_back(extensionIdOf(name, flags & DirFlag));
+    tableInsert(id);
+    ++liveCount;
+
+    if (!bulkLoading && id == trigrams.indexedUpTo())
+        trigrams.add(id, foldedView(e));
+    return id;
+}
+
+uint8_t FileIndex::rankOf(uint32_t parent, string_view name, bool isDir) const {
+    unsigned int depth = parent == NoParent ? 0 : Ranking::depthOf(ranks[parent]) + 1;
+    return Ranking::pack(Ranking::kindOf(name, isDir), depth);
+}
+
+uint16_t FileIndex::extensionIdOf(string_view name, bool isDir) {
+    if (isDir) return 0;
+    string extension = Attributes::extensionOf(name);
+    if (extension.empty()) return 0;
+
+    auto it = extensionIds.find(extension);
+    if (it != extensionIds.end()) return it->second;
+    if (extensionNames.size() >= OverflowExtension) return OverflowExtension;
+
+    uint16_t id = uint16_t(extensionNames.size());
+    extensionNames.push_back(extension);
+    extensionIds.emplace(move(extension), id);
+    return id;
+}
+
+void FileIndex::setAttributesLocked(uint32_t id, const FileAttributes& attributes) {
+    if (!attributes.known()) return;
+    sizes[id] = (entries[id].flags & DirFlag) ? 0 : Attributes::packSize(attributes.size);
+    mtimes[id] = Attributes::unixTime(attributes.mtime);
+}
+
+void FileIndex::resetExtensions() {
+    extensionNames.assign(1, string());
+    extensionIds.clear();
+}
+
+// Children hang off their parent as a list, a root has no list to be in
+void FileIndex::linkChild(uint32_t parent, uint32_t id) {
+    if (parent == NoParent) return;
+    nextSibling[id] = firstChild[parent];
+    firstChild[parent] = id;
+}
+
+void FileIndex::unlinkChild(uint32_t parent, uint32_t id) {
+    if (parent == NoParent) return;
+    if (firstChild[parent] == id) {
+        firstChild[parent] = nextSibling[id];
+    } else {
+        uint32_t cur = firstChild[parent];
+        while (cur != NoParent && nextSibling[cur] != id)
+            cur = nextSibling[cur];
+        if (cur != NoParent) nextSibling[cur] = nextSibling[id];
+    }
+    nextSibling[id] = NoParent;
+}
+
+// id and the entries below it that are not already deleted
+size_t FileIndex::liveSubtreeSize(uint32_t id) const {
+    size_t count = 0;
+    vector<uint32_t> pending(1, id);
+    while (!pending.empty()) {
+        uint32_t next = pending.back(); pending.pop_back();
+        ++count;
+        for (uint32_t child = firstChild[next]; child != NoParent; child = nextSibling[child])
+            if (!(entries[child].flags & DeletedFlag)) pending.push_back(child);
+    }
+    return count;
+}
+
+// Only id is marked, its descendants become unreachable along with it
+void FileIndex::eraseSubtree(uint32_t id) {
+    liveCount -= liveSubtreeSize(id);
+    tableErase(id);
+    entries[id].flags |= DeletedFlag;
+}
+
+// A folder moved to another level takes its subtree along, nothing outside it is touched
+void FileIndex::refreshDepthsBelow(uint32_t folder) {
+    vector<uint32_t> pending(1, folder);
+    while (!pending.empty()) {
+        uint32_t id = pending.back();
+        pending.pop_back();
+        unsigned int depth = Ranking::depthOf(ranks[id]) + 1;
+        for (uint32_t child = firstChild[id]; child != NoParent; child = nextSibling[child]) {
+            ranks[child] = Ranking::pack(Ranking::kindOf(ranks[child]), depth);
+            if (entries[child].flags & DirFlag) pending.push_back(child);
+        }
+    }
+}
+
+uint32_t FileIndex::ensureParents(const vector<string_view>& parts, size_t count) {
+    uint32_t parent = NoParent;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t id = childOf(parent, parts[i]);
+        if (id == NoParent)
+            id = createEntry(parent, parts[i], DirFlag, 0);
+        parent = id;
+    }
+    return parent;
+}
+
+uint32_t FileIndex::addPath(const string& path, char type, int priority, const FileAttributes& attributes) {
+    unique_lock<shared_mutex> guard(lock);
+    ++version;
+    return addPathLocked(path, type, priority, attributes);
+}
+
+uint32_t FileIndex::addPathLocked(const string& path, char type, int priority, const FileAttributes& attributes) {
+    vector<string_view> parts = splitPath(path);
+    if (parts.empty()) return NoParent;
+
+    uint32_t parent = ensureParents(parts, parts.size() - 1);
+
+    uint32_t id = childOf(parent, parts.back());
+    if (id != NoParent) {
+        Entry& e = entries[id];
+        e.flags = (type == 'd') ? (e.flags | DirFlag) : (e.flags & ~DirFlag);
+        e.priority = int8_t(priority);
+        ranks[id] = rankOf(parent, parts.back(), type == 'd');
+        extensions[id] = extensionIdOf(parts.back(), type == 'd');
+        setAttributesLocked(id, attributes);
+        return id;
+    }
+
+    return createEntry(parent, parts.back(), type == 'd' ? DirFlag : 0, priority, attributes);
+}
+
+uint32_t FileIndex::addChild(uint32_t parent, string_view name, char type, int priority,
+                             const FileAttributes& attributes) {
+    unique_lock<shared_mutex> guard(lock);
+    if (parent != NoParent && parent >= entries.size()) return NoParent;
+    ++version;
+
+    uint32_t id = childOf(parent, name);
+    if (id != NoParent) {
+        Entry& e = entries[id];
+        e.flags = (type == 'd') ? (e.flags | DirFlag) : (e.flags & ~DirFlag);
+        e.priority = int8_t(priority);
+        ranks[id] = rankOf(parent, name, type == 'd');
+        extensions[id] = extensionIdOf(name, type == 'd');
+        setAttributesLocked(id, attributes);
+        return id;
+    }
+    return createEntry(parent, name, type == 'd' ? DirFlag : 0, priority, attributes);
+}
+
+uint32_t FileIndex::findLocked(const string& path) const {
+    uint32_t id = NoParent;
+    for (string_view part : splitPath(path)) {
+        id = childOf(id, part);
+        if (id == NoParent) break;
+    }
+    return id;
+}
+
+uint32_t FileIndex::find(const string& path) const {
+    shared_lock<shared_mutex> guard(lock);
+    return findLocked(path);
+}
+
+bool FileIndex::removePath(const string& path) {
+    unique_lock<shared_mutex> guard(lock);
+    ++version;
+    return removePathLocked(path);
+}
+
+bool FileIndex::removePathLocked(const string& path) {
+    uint32_t id = findLocked(path);
+    if (id == NoParent) return false;
+
+    eraseSubtree(id);
+    return true;
+}
+
+bool FileIndex::renamePath(const string& oldPath, const string& newPath) {
+    unique_lock<shared_mutex> guard(lock);
+    ++version;
+    return renamePathLocked(oldPath, newPath);
+}
+
+bool FileIndex::renamePathLocked(const string& oldPath, const string& newPath) {
+    vector<string_view> parts = splitPath(newPath);
+    if (parts.empty()) return false;
+
+    uint32_t id = findLocked(oldPath);
+    if (id == NoParent) return false;
+
+    // A folder can't move into itself or below itself, that would cut it off from the root
+    uint32_t ancestor = NoParent;
+    for (size_t i = 0; i + 1 < parts.size(); ++i) {
+        ancestor = childOf(ancestor, parts[i]);
+        if (ancestor == NoParent) break;
+        if (ancestor == id) return false;
+    }
+
+    uint32_t parent = ensureParents(parts, parts.size() - 1);
+
+    // Renaming over an existing entry replaces it
+    uint32_t existing = childOf(parent, parts.back());
+    if (existing != NoParent && existing != id)
+        eraseSubtree(existing);
+
+    tableErase(id);
+    Entry& e = entries[id];
+    if (e.parent != parent) {
+        unlinkChild(e.parent, id);
+        linkChild(parent, id);
+    }
+    e.parent = parent;
+    if (nameView(e) != parts.back()) {
+        e.nameOffset = appendName(parts.back(), id);
+        e.nameLength = uint16_t(min<size_t>(parts.back().size(), UINT16_MAX));
+        charMasks[id] = FuzzyMatch::charMask(foldedView(e));
+        extensions[id] = extensionIdOf(parts.back(), e.flags & DirFlag);
+
+        // Old trigrams stay behind, the substring check filters them out
+        if (id < trigrams.indexedUpTo())
+            trigrams.addLate(id, foldedView(e));
+        else if (bulkLoading)
+            bulkRenames.push_back(id);
+        ++renameCount;
+    }
+    tableInsert(id);
+
+    unsigned int oldDepth = Ranking::depthOf(ranks[id]);
+    ranks[id] = rankOf(parent, parts.back(), e.flags & DirFlag);
+    if ((e.flags & DirFlag) && Ranking::depthOf(ranks[id]) != oldDepth)
+        refreshDepthsBelow(id);
+    return true;
+}
+
+size_t FileIndex::apply(const vector<Change>& changes) {
+    static Histogram& waits = Metrics::histogram("index.write_lock_wait");
+    unique_lock<shared_mutex> guard(lock, defer_lock);
+    lockTimed(guard, waits);
+    ++version;
+
+    size_t applied = 0;
+    for (const Change& change : changes) {
+        bool done = false;
+        switch (change.kind) {
+        case Change::Add:
+            done = addPathLocked(change.path, change.type, change.priority, change.attributes) != NoParent;
+            break;
+        case Change::Remove:
+            done = removePathLocked(change.path);
+            break;
+        case Change::Rename:
+            done = renamePathLocked(change.oldPath, change.path)
+                   || addPathLocked(change.path, change.type, change.priority, change.attributes) != NoParent;
+            break;
+        case Change::Stamp:
+            done = setStampLocked(findLocked(change.path), change.stamp);
+            break;
+        }
+        applied += done;
+    }
+    return applied;
+}
+
+void FileIndex::clear() {
+    unique_lock<shared_mutex> guard(lock);
+    entries.clear();
+    names.clear();
+    folded.clear();
+    records.clear();
+    stamps.clear();
+    ranks.clear();
+    firstChild.clear();
+    nextSibling.clear();
+    charMasks.clear();
+    sizes.clear();
+    mtimes.clear();
+    extensions.clear();
+    resetExtensions();
+    liveCount = 0;
+    trigrams.clear();
+    rehash(1024);
+    snapshot = SnapshotReader();
+    ++version;
+}
+
+void FileIndex::beginBulkLoad() {
+    unique_lock<shared_mutex> guard(lock);
+    bulkLoading = true;
+    bulkRenames.clear();
+}
+
+/*
+The loaded names are indexed under the shared lock so searches go on during
+the build, only stitching the lists in takes the exclusive one. Whatever was
+added or renamed in between is indexed then.
+*/
+void FileIndex::endBulkLoad(unsigned int numThreads) {
+    TrigramIndex built;
+    uint32_t firstId, lastId;
+    {
+        shared_lock<shared_mutex> guard(lock);
+        firstId = trigrams.indexedUpTo();
+        lastId = uint32_t(entries.size());
+        built.build(firstId, lastId, [this](uint32_t id) { return foldedView(entries[id]); }, numThreads);
+    }
+
+    unique_lock<shared_mutex> guard(lock);
+    // A clear() or openSnapshot() in between leaves the built lists pointing at other names
+    bool unchanged = bulkLoading && trigrams.indexedUpTo() == firstId && entries.size() >= lastId;
+    if (unchanged) {
+        trigrams.append(move(built));
+        for (uint32_t id : bulkRenames)
+            if (id < lastId) trigrams.addLate(id, foldedView(entries[id]));
+    }
+    trigrams.build(trigrams.indexedUpTo(), uint32_t(entries.size()),
+                   [this](uint32_t id) { return foldedView(entries[id]); }, unchanged ? 1 : numThreads);
+    bulkRenames.clear();
+    bulkLoading = false;
+    ++version;
+}
+
+bool FileIndex::collect(uint32_t id, TopK& top) const {
+    const Entry& e = entries[id];
+    if ((e.flags & DeletedFlag) || !isAlive(e.parent)) return false;
+
+    top.push(Ranking::key(e.priority > 0, ranks[id], e.nameLength, id));
+    return true;
+}
+
+void FileIndex::scanArena(const string& needle, size_t firstRecord, size_t lastRecord, uint32_t minId,
+                          TopK& top, Progress& progress) const {
+    if (firstRecord >= lastRecord) return;
+
+    const char* base = folded.data();
+    const char* end = base + (lastRecord < records.size() ? records[lastRecord].offset : folded.size());
+    const char* p = base + records[firstRecord].offset;
+    size_t record = firstRecord;
+    vector<uint32_t> pending;
+    size_t hits = 0;
+
+    // Names are '\0' separated, so a hit never spans two of them
+    while (p < end) {
+        if ((++hits & 255) == 0 && progress.cancelled()) return;
+
+        const char* hit = SimdSearch::find(p, end, needle);
+        if (!hit) break;
+
+        uint32_t offset = uint32_t(hit - base);
+        auto it = upper_bound(records.begin() + record, records.begin() + lastRecord, offset,
+                              [](uint32_t value, const NameRecord& r) { return value < r.offset; });
+        record = size_t(it - records.begin()) - 1;
+
+        // Skip names that were replaced by a rename and entries the trigram lists already cover
+        const NameRecord& r = records[record];
+        if (r.id >= minId && entries[r.id].nameOffset == r.offset && collect(r.id, top))
+            progress.found(pending, r.id);
+
+        p = (record + 1 < records.size()) ? base + records[record + 1].offset : end;
+    }
+    progress.flush(pending);
+}
+
+void FileIndex::matchLocked(const string& needle, TopK& top, Progress& progress) const {
+    vector<uint32_t> candidates;
+    uint32_t linearFrom = 0;
+
+    // Trigram candidates only need the substring check
+    if (trigrams.candidates(needle, candidates)) {
+        vector<uint32_t> pending;
+        size_t checked = 0;
+        for (uint32_t id : candidates) {
+            if ((++checked & 1023) == 0 && progress.cancelled()) return;
+            if (foldedView(entries[id]).find(needle) == string_view::npos) continue;
+            if (collect(id, top))
+                progress.found(pending, id);
+        }
+        progress.flush(pending);
+        linearFrom = trigrams.indexedUpTo();
+    }
+
+    // Names not covered by the trigram index yet (short queries, bulk load in progress)
+    if (linearFrom < entries.size()) {
+        unsigned int numThreads = thread::hardware_concurrency();
+        unsigned int usableThreads = max(2u, numThreads > 2 ? numThreads - 2 : numThreads);
+        size_t chunkSize = records.size() / usableThreads + 1;
+
+        // Every chunk keeps its own best results, merged once all of them are done
+        vector<TopK> tops(usableThreads, TopK(top.limit()));
+        auto scanChunk = [&](unsigned int chunk) {
+            size_t begin = min(records.size(), chunk * chunkSize);
+            size_t end = min(records.size(), begin + chunkSize);
+            scanArena(needle, begin, end, linearFrom, tops[chunk], progress);
+        };
+
+        vector<thread> threads;
+        for (unsigned int i = 1; i < usableThreads; ++i)
+            threads.emplace_back(scanChunk, i);
+        scanChunk(0);
+        for (auto& t : threads)
+            t.join();
+
+        for (const TopK& chunkTop : tops)
+            top.merge(chunkTop);
+    }
+}
+
+vector<uint32_t> FileIndex::search(const string& text, size_t maxResults) const {
+    string needle = text;
+    foldCase(needle);
+
+    shared_lock<shared_mutex> guard(lock);
+    Progress progress(nullptr);
+    TopK top(maxResults);
+    matchLocked(needle, top, progress);
+    return top.ids();
+}
+
+FileIndex::MatchSet FileIndex::matchAll(const string& text, const SearchControl* control) const {
+    string needle = text;
+    foldCase(needle);
+
+    static Histogram& waits = Metrics::histogram("index.read_lock_wait");
+    shared_lock<shared_mutex> guard(lock, defer_lock);
+    lockTimed(guard, waits);
+    Progress progress(control);
+    MatchSet matches;
+    TopK all(SIZE_MAX);
+    matchLocked(needle, all, progress);
+    matches.ids = all.unrankedIds();
+    sort(matches.ids.begin(), matches.ids.end());
+    matches.endId = uint32_t(entries.size());
+    matches.renameCount = renameCount;
+    matches.complete = !progress.wasCancelled();
+    return matches;
+}
+
+FileIndex::MatchSet FileIndex::narrow(const MatchSet& previous, const string& text, const SearchControl* control) const {
+    string needle = text;
+    foldCase(needle);
+
+    static Histogram& waits = Metrics::histogram("index.read_lock_wait");
+    shared_lock<shared_mutex> guard(lock, defer_lock);
+    lockTimed(guard, waits);
+
+    // A renamed entry may match now without being in the old set
+    if (!previous.complete || previous.renameCount != renameCount || previous.endId > entries.size()) {
+        guard.unlock();
+        return matchAll(text, control);
+    }
+
+    Progress progress(control);
+    MatchSet matches;
+    vector<uint32_t> pending;
+    size_t checked = 0;
+    auto keep = [&](uint32_t id) {
+        const Entry& e = entries[id];
+        if (!(e.flags & DeletedFlag) && foldedView(e).find(needle) != string_view::npos && isAlive(e.parent)) {
+            matches.ids.push_back(id);
+            progress.found(pending, id);
+        }
+        return (++checked & 1023) != 0 || !progress.cancelled();
+    };
+
+    bool finished = true;
+    for (size_t i = 0; i < previous.ids.size() && finished; ++i)
+        finished = keep(previous.ids[i]);
+    // Entries added since the previous query were never checked
+    for (uint32_t id = previous.endId; id < entries.size() && finished; ++id)
+        finished = keep(id);
+    progress.flush(pending);
+
+    matches.endId = uint32_t(entries.size());
+    matches.renameCount = renameCount;
+    matches.complete = finished;
+    return matches;
+}
+
+vector<uint32_t> FileIndex::topResults(const vector<uint32_t>& ids, size_t maxResults) const {
+    shared_lock<shared_mutex> guard(lock);
+    TopK top(maxResults);
+    for (uint32_t id : ids) {
+        if (id < entries.size()) collect(id, top);
+    }
+    return top.ids();
+}
+
+/*
+The filter runs over the columns a block at a time: every check is one plain
+loop over a block of one column, which the compiler turns into vector code,
+and a name is only looked at for the rare extension past the interned ones.
+*/
+void FileIndex::filterLocked(const AttributeFilter& filter, vector<uint32_t>& ids, Progress& progress) const {
+    static Histogram& scanTimes = Metrics::histogram("query.attribute_scan");
+    auto start = chrono::steady_clock::now();
+    ids.clear();
+
+    // Extension and size filters only ever match files
+    bool byExtension = !filter.extensions.empty() || !filter.kinds.empty();
+    bool filesOnly = filter.type == AttributeFilter::FilesOnly || filter.sized || byExtension;
+    if (filesOnly && filter.type == AttributeFilter::FoldersOnly) return;
+
+    // One byte per extension id, a file has to be in both lists when both are given
+    vector<uint8_t> allowed;
+    if (byExtension) {
+        allowed.assign(size_t(OverflowExtension) + 1, 0);
+        auto mark = [&](const vector<string>& list, uint8_t bit) {
+            for (const string& extension : list) {
+                if (extension.empty()) {
+                    allowed[0] |= bit;
+                    continue;
+                }
+                auto it = extensionIds.find(extension);
+                if (it != extensionIds.end()) allowed[it->second] |= bit;
+            }
+            allowed[OverflowExtension] |= bit; // decided by name below
+        };
+        mark(filter.extensions.empty() ? filter.kinds : filter.extensions, 1);
+        mark(filter.kinds.empty() ? filter.extensions : filter.kinds, 2);
+    }
+    auto inLists = [&](string_view name) {
+        string extension = Attributes::extensionOf(name);
+        auto listed = [&](const vector<string>& list) {
+            return list.empty() || std::find(list.begin(), list.end(), extension) != list.end();
+        };
+        return listed(filter.extensions) && listed(filter.kinds);
+    };
+
+    const size_t BlockSize = 1024;
+    uint8_t keep[BlockSize];
+    for (size_t first = 0; first < entries.size(); first += BlockSize) {
+        if (progress.cancelled()) return;
+        size_t count = min(BlockSize, entries.size() - first);
+        const Entry* e = &entries[first];
+
+        for (size_t i = 0; i < count; ++i)
+            keep[i] = !(e[i].flags & DeletedFlag);
+        if (filesOnly) {
+            for (size_t i = 0; i < count; ++i)
+                keep[i] &= !(e[i].flags & DirFlag);
+        } else if (filter.type == AttributeFilter::FoldersOnly) {
+            for (size_t i = 0; i < count; ++i)
+                keep[i] &= (e[i].flags & DirFlag) != 0;
+        }
+        if (filter.sized) {
+            const uint32_t* size = &sizes[first];
+            for (size_t i = 0; i < count; ++i)
+                keep[i] &= size[i] >= filter.minSize && size[i] <= filter.maxSize && size[i] != Attributes::UnknownSize;
+        }
+        if (filter.dated) {
+            const uint32_t* mtime = &mtimes[first];
+            for (size_t i = 0; i < count; ++i)
+                keep[i] &= mtime[i] >= filter.minTime && mtime[i] <= filter.maxTime;
+        }
+        if (byExtension) {
+            const uint16_t* extension = &extensions[first];
+            for (size_t i = 0; i < count; ++i)
+                keep[i] &= allowed[extension[i]] == 3;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!keep[i]) continue;
+            uint32_t id = uint32_t(first + i);
+            if (byExtension && extensions[id] == OverflowExtension && !inLists(nameView(e[i]))) continue;
+            if (isAlive(e[i].parent)) ids.push_back(id);
+        }
+    }
+    scanTimes.record(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+}
+
+FileIndex::MatchSet FileIndex::matchWhere(const string& literal, const function<bool(string_view)>& accept,
+                                          const AttributeFilter& filter, const SearchControl* control,
+                                          FilterStats* stats) const {
+    string needle = literal;
+    foldCase(needle);
+    bool filtered = !filter.empty();
+
+    static Histogram& waits = Metrics::histogram("index.read_lock_wait");
+    static Histogram& prefilterTimes = Metrics::histogram("query.prefilter");
+    static Histogram& verifyTimes = Metrics::histogram("query.verify");
+    static Counter& candidateCount = Metrics::counter("query.prefilter_candidates");
+    static Counter& matchCount = Metrics::counter("query.verify_matches");
+    shared_lock<shared_mutex> guard(lock, defer_lock);
+    lockTimed(guard, waits);
+    auto msSince = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    // Candidates are not results yet, only matched names are handed out early
+    SearchControl quiet;
+    if (control) quiet.cancelled = control->cancelled;
+    Progress prefilter(&quiet);
+    vector<uint32_t> candidates;
+    auto start = chrono::steady_clock::now();
+    if (filtered) {
+        filterLocked(filter, candidates, prefilter);
+    } else if (!needle.empty()) {
+        TopK all(SIZE_MAX);
+        matchLocked(needle, all, prefilter);
+        candidates = all.unrankedIds();
+        sort(candidates.begin(), candidates.end());
+    } else {
+        candidates.reserve(liveCount);
+        for (uint32_t id = 0; id < entries.size(); ++id) {
+            if (!(entries[id].flags & DeletedFlag)) candidates.push_back(id);
+        }
+    }
+    double prefilterMs = msSince(start);
+    prefilterTimes.record(prefilterMs);
+    candidateCount.add(candidates.size());
+
+    // Chunks keep id order, so the parts only need to be put back together
+    start = chrono::steady_clock::now();
+    Progress progress(control);
+    unsigned int numThreads = thread::hardware_concurrency();
+    unsigned int usableThreads = max(2u, numThreads > 2 ? numThreads - 2 : numThreads);
+    if (candidates.size() < 4096) usableThreads = 1; // not worth starting threads for
+    size_t chunkSize = candidates.size() / usableThreads + 1;
+    vector<vector<uint32_t>> kept(usableThreads);
+    auto verifyChunk = [&](unsigned int chunk) {
+        size_t begin = min(candidates.size(), chunk * chunkSize);
+        size_t end = min(candidates.size(), begin + chunkSize);
+        vector<uint32_t> pending;
+        for (size_t i = begin; i < end; ++i) {
+            if (((i - begin) & 1023) == 1023 && progress.cancelled()) break;
+            uint32_t id = candidates[i];
+            const Entry& e = entries[id];
+            if (filtered && !needle.empty() && foldedView(e).find(needle) == string_view::npos) continue;
+            if ((accept && !accept(nameView(e))) || !isAlive(e.parent)) continue;
+            kept[chunk].push_back(id);
+            progress.found(pending, id);
+        }
+        progress.flush(pending);
+    };
+
+    if (!prefilter.wasCancelled()) {
+        vector<thread> threads;
+        for (unsigned int i = 1; i < usableThreads; ++i)
+            threads.emplace_back(verifyChunk, i);
+        verifyChunk(0);
+        for (auto& t : threads)
+            t.join();
+    }
+
+    MatchSet matches;
+    for (const vector<uint32_t>& part : kept)
+        matches.ids.insert(matches.ids.end(), part.begin(), part.end());
+    matches.endId = uint32_t(entries.size());
+    matches.renameCount = renameCount;
+    matches.complete = !prefilter.wasCancelled() && !progress.wasCancelled();
+    double verifyMs = msSince(start);
+    verifyTimes.record(verifyMs);
+    matchCount.add(matches.ids.size());
+
+    if (stats) {
+        stats->candidates = candidates.size();
+        stats->matches = matches.ids.size();
+        stats->prefilterMs = prefilterMs;
+        stats->verifyMs = verifyMs;
+    }
+    return matches;
+}
+
+vector<uint32_t> FileIndex::fuzzySearch(const string& text, size_t maxResults, const AttributeFilter& filter,
+                                         const SearchControl* control) const {
+    string pattern = FuzzyMatch::pattern(text);
+    if (pattern.empty()) return {};
+    uint32_t required = FuzzyMatch::charMask(pattern);
+
+    static Histogram& waits = Metrics::histogram("index.read_lock_wait");
+    static Counter& scored = Metrics::counter("query.fuzzy_scored");
+    static Counter& skipped = Metrics::counter("query.fuzzy_skipped");
+    shared_lock<shared_mutex> guard(lock, defer_lock);
+    lockTimed(guard, waits);
+    Progress progress(control);
+
+    // A filter picks the entries first, only those are scored
+    vector<uint32_t> filteredIds;
+    bool filtered = !filter.empty();
+    if (filtered) {
+        filterLocked(filter, filteredIds, progress);
+        if (progress.wasCancelled()) return {};
+    }
+
+    unsigned int numThreads = thread::hardware_concurrency();
+    unsigned int usableThreads = max(2u, numThreads > 2 ? numThreads - 2 : numThreads);
+    size_t count = filtered ? filteredIds.size() : entries.size();
+    size_t chunkSize = count / usableThreads + 1;
+
+    vector<TopK> tops(usableThreads, TopK(maxResults));
+    auto scanChunk = [&](unsigned int chunk) {
+        size_t begin = min(count, chunk * chunkSize);
+        size_t end = min(count, begin + chunkSize);
+        vector<uint32_t> pending;
+        uint64_t checked = 0;
+        size_t i = begin;
+        for (; i < end; ++i) {
+            if (((i - begin) & 4095) == 4095 && progress.cancelled()) break;
+            uint32_t id = filtered ? filteredIds[i] : uint32_t(i);
+            // Most names lack one of the characters and are never read
+            if ((charMasks[id] & required) != required) continue;
+
+            const Entry& e = entries[id];
+            if ((e.flags & DeletedFlag) || e.nameLength < pattern.size()) continue;
+            ++checked;
+            int score = FuzzyMatch::score(nameView(e), foldedView(e), pattern);
+            if (score == FuzzyMatch::NoMatch || !isAlive(e.parent)) continue;
+
+            tops[chunk].push(Ranking::fuzzyKey(score, e.priority > 0, ranks[id], e.nameLength, id));
+            progress.found(pending, id);
+        }
+        progress.flush(pending);
+        scored.add(checked);
+        skipped.add(i - begin - checked);
+    };
+
+    vector<thread> threads;
+    for (unsigned int i = 1; i < usableThreads; ++i)
+        threads.emplace_back(scanChunk, i);
+    scanChunk(0);
+    for (auto& t : threads)
+        t.join();
+
+    TopK top(maxResults);
+    for (const TopK& chunkTop : tops)
+        top.merge(chunkTop);
+    return top.ids();
+}
+
+string FileIndex::pathOfLocked(uint32_t id) const {
+    vector<uint32_t> chain;
+    for (uint32_t cur = id; cur != NoParent; cur = entries[cur].parent)
+        chain.push_back(cur);
+
+    string path(nameView(entries[chain.back()]));
+    if (chain.size() == 1) {
+        path += Separator;
+        return path;
+    }
+    for (size_t i = chain.size() - 1; i-- > 0;) {
+        path += Separator;
+        path += nameView(entries[chain[i]]);
+    }
+    return path;
+}
+
+string FileIndex::pathOf(uint32_t id) const {
+    shared_lock<shared_mutex> guard(lock);
+    if (id >= entries.size() || !isAlive(id)) return string();
+    return pathOfLocked(id);
+}
+
+bool FileIndex::entryInfo(uint32_t id, EntryInfo& info) const {
+    shared_lock<shared_mutex> guard(lock);
+    if (id >= entries.size()) return false;
+
+    const Entry& e = entries[id];
+    info.parent = e.parent;
+    info.name.assign(nameView(e));
+    info.type = (e.flags & DirFlag) ? 'd' : 'f';
+    info.priority = e.priority;
+    info.alive = isAlive(id);
+    info.attributes.mtime = Attributes::ticksOf(mtimes[id]);
+    info.attributes.size = Attributes::unpackSize(sizes[id]);
+    return true;
+}
+
+bool FileIndex::attributesDiffer(uint32_t id, const FileAttributes& attributes) const {
+    if (!attributes.known()) return false;
+    shared_lock<shared_mutex> guard(lock);
+    if (id >= entries.size() || (entries[id].flags & DirFlag)) return false;
+    return sizes[id] != Attributes::packSize(attributes.size) || mtimes[id] != Attributes::unixTime(attributes.mtime);
+}
+
+uint32_t FileIndex::endId() const {
+    shared_lock<shared_mutex> guard(lock);
+    return uint32_t(entries.size());
+}
+
+void FileIndex::childLists(vector<uint32_t>& offsets, vector<uint32_t>& children) const {
+    shared_lock<shared_mutex> guard(lock);
+    uint32_t count = uint32_t(entries.size());
+    auto slotOf = [count](uint32_t parent) { return parent == NoParent ? count : parent; };
+
+    // Counting sort by parent, children of a removed folder are never reached
+    offsets.assign(size_t(count) + 2, 0);
+    for (const Entry& e : entries) {
+        if (!(e.flags & DeletedFlag))
+            ++offsets[slotOf(e.parent) + 1];
+    }
+    for (size_t i = 1; i < offsets.size(); ++i)
+        offsets[i] += offsets[i - 1];
+
+    children.resize(offsets.back());
+    vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (uint32_t id = 0; id < count; ++id) {
+        const Entry& e = entries[id];
+        if (!(e.flags & DeletedFlag))
+            children[next[slotOf(e.parent)]++] = id;
+    }
+}
+
+string FileIndex::nameOf(uint32_t id) const {
+    shared_lock<shared_mutex> guard(lock);
+    if (id >= entries.size()) return string();
+    return string(nameView(entries[id]));
+}
+
+char FileIndex::typeOf(uint32_t id) const {
+    shared_lock<shared_mutex> guard(lock);
+    if (id >= entries.size()) return '?';
+    return (entries[id].flags & DirFlag) ? 'd' : 'f';
+}
+
+size_t FileIndex::size() const {
+    shared_lock<shared_mutex> guard(lock);
+    return liveCount;
+}
+
+size_t FileIndex::memoryUsage() const {
+    shared_lock<shared_mutex> guard(lock);
+    return entries.capacity() * sizeof(Entry)
+         + names.capacity() + folded.capacity() + ranks.capacity()
+         + (charMasks.capacity() + sizes.capacity() + mtimes.capacity()) * sizeof(uint32_t)
+         + (firstChild.capacity() + nextSibling.capacity()) * sizeof(uint32_t)
+         + extensions.capacity() * sizeof(uint16_t)
+         + records.capacity() * sizeof(NameRecord)
+         + table.capacity() * sizeof(uint32_t)
+         + trigrams.memoryUsage();
+}
+
+DirStamp FileIndex::stampOf(uint32_t id) const {
+    shared_lock<shared_mutex> guard(lock);
+    return id < stamps.size() ? stamps[id] : DirStamp();
+}
+
+void FileIndex::setStamp(uint32_t id, const DirStamp& stamp) {
+    unique_lock<shared_mutex> guard(lock);
+    if (setStampLocked(id, stamp)) ++version;
+}
+
+bool FileIndex::setStampLocked(uint32_t id, const DirStamp& stamp) {
+    if (id >= entries.size()) return false;
+    if (id >= stamps.size()) stamps.resize(size_t(id) + 1);
+    stamps[id] = stamp;
+    return true;
+}
+
+void FileIndex::setStamps(vector<DirStamp> folderStamps) {
+    unique_lock<shared_mutex> guard(lock);
+    stamps.adopt(move(folderStamps));
+    ++version;
+}
+
+bool FileIndex::writeSnapshotLocked(const string& basePath) const {
+    static_assert(is_trivially_copyable<Entry>::value && sizeof(Entry) == 12, "Entry is written as raw bytes");
+
+    SnapshotMeta meta = { liveCount, tableUsed, renameCount, trigrams.indexedUpTo(), uint32_t(sizeof(Entry)) };
+    vector<TrigramIndex::FrozenList> lists;
+    vector<uint8_t> postings;
+    trigrams.freeze(lists, postings);
+
+    string extensionList; // '\0' after each name
+    for (const string& extension : extensionNames) {
+        extensionList += extension;
+        extensionList += '\0';
+    }
+
+    SnapshotWriter writer;
+    writer.add(MetaSection, &meta, sizeof(meta));
+    writer.add(EntrySection, entries.data(), entries.size() * sizeof(Entry));
+    writer.add(NameSection, names.data(), names.size());
+    writer.add(FoldedSection, folded.data(), folded.size());
+    writer.add(RecordSection, records.data(), records.size() * sizeof(NameRecord));
+    writer.add(TableSection, table.data(), table.size() * sizeof(uint32_t));
+    writer.add(StampSection, stamps.data(), stamps.size() * sizeof(DirStamp));
+    writer.add(TrigramListSection, lists.data(), lists.size() * sizeof(TrigramIndex::FrozenList));
+    writer.add(TrigramByteSection, postings.data(), postings.size());
+    writer.add(RankSection, ranks.data(), ranks.size());
+    writer.add(CharMaskSection, charMasks.data(), charMasks.size() * sizeof(uint32_t));
+    writer.add(SizeSection, sizes.data(), sizes.size() * sizeof(uint32_t));
+    writer.add(TimeSection, mtimes.data(), mtimes.size() * sizeof(uint32_t));
+    writer.add(ExtensionSection, extensions.data(), extensions.size() * sizeof(uint16_t));
+    writer.add(ExtensionNameSection, extensionList.data(), extensionList.size());
+    writer.add(ChildSection, firstChild.data(), firstChild.size() * sizeof(uint32_t));
+    writer.add(SiblingSection, nextSibling.data(), nextSibling.size() * sizeof(uint32_t));
+    return writer.write(basePath);
+}
+
+bool FileIndex::mapSnapshotLocked(SnapshotReader& reader) {
+    const SnapshotMeta* meta;
+    const Entry* entryData;
+    const char* nameData;
+    const char* foldedData;
+    const NameRecord* recordData;
+    const uint32_t* tableData;
+    const DirStamp* stampData;
+    const TrigramIndex::FrozenList* listData;
+    const uint8_t* postingData;
+    const uint8_t* rankData;
+    const uint32_t* maskData;
+    const uint32_t* sizeData;
+    const uint32_t* timeData;
+    const uint16_t* extensionData;
+    const char* extensionNameData;
+    const uint32_t* childData;
+    const uint32_t* siblingData;
+    size_t metaCount, entryCount, nameCount, foldedCount, recordCount, tableCount, stampCount, listCount, postingCount,
+        rankCount, maskCount, sizeCount, timeCount, extensionCount, extensionNameCount, childCount, siblingCount;
+
+    if (!sectionOf(reader, MetaSection, meta, metaCount) || metaCount != 1 || meta->entrySize != sizeof(Entry)
+        || !sectionOf(reader, EntrySection, entryData, entryCount)
+        || !sectionOf(reader, NameSection, nameData, nameCount)
+        || !sectionOf(reader, FoldedSection, foldedData, foldedCount)
+        || !sectionOf(reader, RecordSection, recordData, recordCount)
+        || !sectionOf(reader, TableSection, tableData, tableCount)
+        || !sectionOf(reader, StampSection, stampData, stampCount)
+        || !sectionOf(reader, TrigramListSection, listData, listCount)
+        || !sectionOf(reader, TrigramByteSection, postingData, postingCount)
+        || !sectionOf(reader, RankSection, rankData, rankCount)
+        || !sectionOf(reader, CharMaskSection, maskData, maskCount)
+        || !sectionOf(reader, SizeSection, sizeData, sizeCount)
+        || !sectionOf(reader, TimeSection, timeData, timeCount)
+        || !sectionOf(reader, ExtensionSection, extensionData, extensionCount)
+        || !sectionOf(reader, ExtensionNameSection, extensionNameData, extensionNameCount)
+        || !sectionOf(reader, ChildSection, childData, childCount)
+        || !sectionOf(reader, SiblingSection, siblingData, siblingCount))
+        return false;
+
+    // Cheap shape checks only, openSnapshot() checked the contents
+    bool powerOfTwo = tableCount >= 1024 && (tableCount & (tableCount - 1)) == 0;
+    if (nameCount != foldedCount || rankCount != entryCount || maskCount != entryCount || sizeCount != entryCount
+        || timeCount != entryCount || extensionCount != entryCount || extensionNameCount == 0
+        || childCount != entryCount || siblingCount != entryCount || !powerOfTwo || meta->trigramEnd > entryCount
+        || entryCount >= NoParent)
+        return false;
+
+    const shared_ptr<MappedFile>& file = reader.file();
+    entries.map(file, entryData, entryCount);
+    names.map(file, nameData, nameCount);
+    folded.map(file, foldedData, foldedCount);
+    records.map(file, recordData, recordCount);
+    table.map(file, tableData, tableCount);
+    stamps.map(file, stampData, stampCount);
+    ranks.map(file, rankData, rankCount);
+    firstChild.map(file, childData, childCount);
+    nextSibling.map(file, siblingData, siblingCount);
+    charMasks.map(file, maskData, maskCount);
+    sizes.map(file, sizeData, sizeCount);
+    mtimes.map(file, timeData, timeCount);
+    extensions.map(file, extensionData, extensionCount);
+
+    // The extension table is small, it lives on the heap. The first name is the empty one.
+    extensionNames.clear();
+    extensionIds.clear();
+    for (size_t pos = 0; pos < extensionNameCount;) {
+        size_t end = pos;
+        while (end < extensionNameCount && extensionNameData[end] != '\0')
+            ++end;
+        extensionNames.emplace_back(extensionNameData + pos, end - pos);
+        if (extensionNames.size() > 1)
+            extensionIds.emplace(extensionNames.back(), uint16_t(extensionNames.size() - 1));
+        pos = end + 1;
+    }
+    trigrams.mapFrozen(listData, listCount, postingData, meta->trigramEnd);
+    tableUsed = size_t(meta->tableUsed);
+    liveCount = size_t(meta->liveCount);
+    renameCount = meta->renameCount;
+    bulkLoading = false;
+    ++version;
+
+    // Keeps the mapping the frozen trigram lists point into
+    snapshot = move(reader);
+    return true;
+}
+
+bool FileIndex::openSnapshot(const string& basePath) {
+    SnapshotReader reader;
+    if (!reader.open(basePath)) return false;
+
+    // Before it goes live, the first search would follow a damaged name offset or parent id
+    if (!reader.verify()) return false;
+
+    unique_lock<shared_mutex> guard(lock);
+    return mapSnapshotLocked(reader);
+}
+
+bool FileIndex::verifySnapshot() const {
+    shared_lock<shared_mutex> guard(lock);
+    return snapshot.verify();
+}
+
+bool FileIndex::checkpoint(const string& basePath) {
+    lock_guard<mutex> serial(checkpointLock);
+    ScopedTimer timer(Metrics::histogram("index.checkpoint"), "index checkpoint");
+    uint64_t writtenAt;
+    {
+        // Searches go on while the file is written, changes wait
+        shared_lock<shared_mutex> guard(lock);
+        if (!writeSnapshotLocked(basePath)) return false;
+        writtenAt = version;
+    }
+
+    SnapshotReader reader;
+    if (!reader.open(basePath)) return true;
+
+    unique_lock<shared_mutex> guard(lock);
+    if (version == writtenAt)
+        mapSnapshotLocked(reader);
+    return true;
+}
@@ -0,0 +1,248 @@
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <shared_mutex>
+#include <unordered_map>
+#include "attributes.h"
+#include "column.h"
+#include "fsbackend.h"
+#include "indexsnapshot.h"
+#include "ranking.h"
+#include "trigramindex.h"
+
+/*
+In-memory index of every scanned file and folder.
+Names are kept in one contiguous arena and each entry only stores its own name
+plus the id of its parent directory, full paths are rebuilt on demand.
+All public methods are thread safe (many readers, one writer at a time).
+The arrays can also be served from a mapped snapshot file, see openSnapshot().
+*/
+class FileIndex {
+public:
+    static constexpr uint32_t NoParent = UINT32_MAX;
+
+#if defined(_WIN32) || defined(_WIN64)
+    static constexpr char Separator = '\\';
+#else
+    static constexpr char Separator = '/';
+#endif
+
+    FileIndex();
+
+    // Adds a path, missing parent folders are created as directories. Returns the entry id.
+    // Unknown attributes leave those of an existing entry alone.
+    uint32_t addPath(const std::string& path, char type, int priority = 0,
+                     const FileAttributes& attributes = FileAttributes());
+    // Removes the entry, everything below a removed folder disappears with it.
+    bool removePath(const std::string& path);
+    // Moves the entry in place, children keep pointing at the same folder id.
+    bool renamePath(const std::string& oldPath, const std::string& newPath);
+
+    // One file system change for apply()
+    struct Change {
+        enum Kind { Add, Remove, Rename, Stamp };
+        Kind kind = Add;
+        std::string path;
+        std::string oldPath; // Rename only
+        char type = 'f';
+        int priority = 0;
+        FileAttributes attributes; // Add only
+        DirStamp stamp;            // Stamp only, the folder at path was listed with it
+    };
+    // Applies a group of changes under one write lock, a search sees all of them or none.
+    // A rename of an unknown entry adds it under the new path. Returns how many took effect.
+    size_t apply(const std::vector<Change>& changes);
+
+    // Adds name below an existing entry (NoParent for a root) without parsing a path
+    uint32_t addChild(uint32_t parent, std::string_view name, char type, int priority = 0,
+                      const FileAttributes& attributes = FileAttributes());
+    void clear();
+
+    // While bulk loading new names skip the trigram index, endBulkLoad indexes them in parallel
+    void beginBulkLoad();
+    void endBulkLoad(unsigned int numThreads);
+
+    // Ids of live entries whose name contains text (case-insensitive), best ranked first.
+    std::vector<uint32_t> search(const std::string& text, size_t maxResults) const;
+
+    // Every match in id order, plus what is needed to narrow it later
+    struct MatchSet {
+        std::vector<uint32_t> ids;
+        uint32_t endId = 0;       // entries at or above this id were not checked
+        uint64_t renameCount = 0; // renames can make old ids match a new query
+        bool complete = true;     // false when the query was cancelled half way
+    };
+
+    // Lets a long query hand out matches while it runs and stop early
+    struct SearchControl {
+        std::function<bool()> cancelled;                           // polled every few thousand names
+        std::function<void(const std::vector<uint32_t>&)> partial; // new matches, not ranked yet
+        size_t batchSize = 64;
+    };
+
+    MatchSet matchAll(const std::string& text, const SearchControl* control = nullptr) const;
+    // Matches of text when every match of it is also a match of the previous query
+    MatchSet narrow(const MatchSet& previous, const std::string& text, const SearchControl* control = nullptr) const;
+    // The best maxResults of ids by Ranking::key, best first
+    std::vector<uint32_t> topResults(const std::vector<uint32_t>& ids, size_t maxResults) const;
+    // How a pattern query went: the prefilter picks candidates by a literal, the matcher checks each
+    struct FilterStats {
+        size_t candidates = 0;
+        size_t matches = 0;
+        double prefilterMs = 0;
+        double verifyMs = 0;
+    };
+    // Live entries that pass filter, whose name contains literal (any name when it is empty) and that
+    // accept takes (any when it is empty), in id order. A filter is scanned first and replaces the
+    // literal lookup. accept runs on the original name from several threads at once.
+    MatchSet matchWhere(const std::string& literal, const std::function<bool(std::string_view name)>& accept,
+                        const AttributeFilter& filter, const SearchControl* control = nullptr,
+                        FilterStats* stats = nullptr) const;
+    // Live entries that pass filter and whose name holds the characters of text in order,
+    // best FuzzyMatch score first
+    std::vector<uint32_t> fuzzySearch(const std::string& text, size_t maxResults,
+                                      const AttributeFilter& filter = AttributeFilter(),
+                                      const SearchControl* control = nullptr) const;
+
+    // Raw fields of one entry, used to write the index out
+    struct EntryInfo {
+        uint32_t parent = NoParent;
+        std::string name;
+        char type = 'f';
+        int priority = 0;
+        bool alive = false;
+        FileAttributes attributes; // to whole seconds, sizes above 2 GiB to whole KiB
+    };
+    bool entryInfo(uint32_t id, EntryInfo& info) const;
+    // True when a file's stored size or time, at the precision kept, is not what attributes say.
+    // Unknown attributes and folders never differ.
+    bool attributesDiffer(uint32_t id, const FileAttributes& attributes) const;
+    // One past the highest id handed out so far, ids are never reused
+    uint32_t endId() const;
+    // Snapshot of the tree: children of id are children[offsets[id] .. offsets[id + 1]),
+    // roots sit in the extra slot at id = endId()
+    void childLists(std::vector<uint32_t>& offsets, std::vector<uint32_t>& children) const;
+
+    std::string pathOf(uint32_t id) const;
+    std::string nameOf(uint32_t id) const;
+    char typeOf(uint32_t id) const;
+    uint32_t find(const std::string& path) const;
+
+    size_t size() const;
+    // Heap only, arrays still served from a snapshot live in the page cache
+    size_t memoryUsage() const;
+
+    // Folder stamps by id, unknown for files and for folders that were never listed
+    DirStamp stampOf(uint32_t id) const;
+    void setStamp(uint32_t id, const DirStamp& stamp);
+    void setStamps(std::vector<DirStamp> stamps);
+
+    // Replaces the contents with the newest snapshot next to basePath once its checksums match,
+    // a damaged one leaves the index as it was. Searches run on the mapping, the first change
+    // to an array copies that array to the heap.
+    bool openSnapshot(const std::string& basePath);
+    // Compares the checksums of the mapped snapshot, reads all of it
+    bool verifySnapshot() const;
+    // Writes the contents as a new snapshot next to basePath. When nothing changed while
+    // writing, the heap arrays are dropped and served from the new file instead.
+    bool checkpoint(const std::string& basePath);
+
+    // Lower-cases ASCII and the common BMP letters in place, the UTF-8 length stays the same
+    static void foldCase(std::string& text);
+    // Path components, a POSIX path starts with the empty root name
+    static std::vector<std::string_view> splitPath(const std::string& path);
+
+private:
+    enum Flags : uint8_t {
+        DirFlag = 1,
+        DeletedFlag = 2
+    };
+
+    struct Entry {
+        uint32_t nameOffset;
+        uint32_t parent;
+        uint16_t nameLength;
+        uint8_t flags;
+        int8_t priority;
+    };
+
+    std::string_view nameView(const Entry& e) const { return { names.data() + e.nameOffset, e.nameLength }; }
+    std::string_view foldedView(const Entry& e) const { return { folded.data() + e.nameOffset, e.nameLength }; }
+
+    // Every name ever written to the arena and the entry it was written for
+    struct NameRecord {
+        uint32_t offset;
+        uint32_t id;
+    };
+
+    uint32_t appendName(std::string_view name, uint32_t id);
+    uint32_t childOf(uint32_t parent, std::string_view name) const;
+    uint32_t findLocked(const std::string& path) const;
+    uint32_t addPathLocked(const std::string& path, char type, int priority, const FileAttributes& attributes);
+    bool removePathLocked(const std::string& path);
+    bool renamePathLocked(const std::string& oldPath, const std::string& newPath);
+    uint32_t ensureParents(const std::vector<std::string_view>& parts, size_t count);
+    uint32_t createEntry(uint32_t parent, std::string_view name, uint8_t flags, int priority,
+                         const FileAttributes& attributes = FileAttributes());
+    uint8_t rankOf(uint32_t parent, std::string_view name, bool isDir) const;
+    uint16_t extensionIdOf(std::string_view name, bool isDir);
+    void setAttributesLocked(uint32_t id, const FileAttributes& attributes);
+    bool setStampLocked(uint32_t id, const DirStamp& stamp);
+    void resetExtensions();
+    void linkChild(uint32_t parent, uint32_t id);
+    void unlinkChild(uint32_t parent, uint32_t id);
+    void refreshDepthsBelow(uint32_t folder);
+    size_t liveSubtreeSize(uint32_t id) const;
+    void eraseSubtree(uint32_t id);
+    bool isAlive(uint32_t id) const;
+    std::string pathOfLocked(uint32_t id) const;
+    class Progress;
+    void matchLocked(const std::string& needle, TopK& top, Progress& progress) const;
+    bool collect(uint32_t id, TopK& top) const;
+    void filterLocked(const AttributeFilter& filter, std::vector<uint32_t>& ids, Progress& progress) const;
+    void scanArena(const std::string& needle, size_t firstRecord, size_t lastRecord, uint32_t minId,
+                   TopK& top, Progress& progress) const;
+
+    static uint64_t hashKey(uint32_t parent, std::string_view name);
+    uint64_t hashOf(const Entry& e) const;
+    void tableInsert(uint32_t id);
+    void tableErase(uint32_t id);
+    void rehash(size_t capacity);
+
+    bool writeSnapshotLocked(const std::string& basePath) const;
+    bool mapSnapshotLocked(SnapshotReader& reader);
+
+    mutable std::shared_mutex lock;
+    Column<Entry> entries;
+    Column<char> names;     // original names, '\0' after each
+    Column<char> folded;    // same layout, ASCII lower-cased
+    Column<NameRecord> records;
+    Column<uint32_t> table; // open addressing (parent, name) -> id
+    Column<DirStamp> stamps;
+    Column<uint8_t> ranks;  // Ranking::pack of kind and depth, one per entry
+    Column<uint32_t> firstChild;  // newest child, NoParent for none
+    Column<uint32_t> nextSibling; // next older child of the same parent, NoParent at the end
+    Column<uint32_t> charMasks; // FuzzyMatch::charMask of the folded name, one per entry
+    Column<uint32_t> sizes;     // Attributes::packSize, 0 for folders, UnknownSize when not listed
+    Column<uint32_t> mtimes;    // Unix time, 0 when unknown
+    Column<uint16_t> extensions; // into extensionNames, 0 for folders and names without one
+    std::vector<std::string> extensionNames; // interned, lower-cased
+    std::unordered_map<std::string, uint16_t> extensionIds;
+    size_t tableUsed = 0;
+    size_t liveCount = 0;
+    TrigramIndex trigrams;     // covers ids below trigrams.indexedUpTo()
+    bool bulkLoading = false;
+    std::vector<uint32_t> bulkRenames; // renamed while bulk loading, past the trigram index
+    uint64_t renameCount = 0;
+    uint64_t version = 0;      // bumped by every change, tells checkpoint() whether it may remap
+    SnapshotReader snapshot;   // the mapped file, empty when everything lives on the heap
+    std::mutex checkpointLock; // two writers would pick the same generation
+};
+
+#endif // FILEINDEX_H
@@ -0,0 +1,248 @@
+#include "fsbackend.h"
+
+#include <cctype>
+#include <cstring>
+#include <cwchar>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+string FsBackend::join(const string& dir, string_view name) const {
+    string path;
+    path.reserve(dir.size() + name.size() + 1);
+    path = dir;
+    if (path.empty() || path.back() != separator())
+        path += separator();
+    path.append(name.data(), name.size());
+    return path;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+wstring toWide(const string& text) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), int(text.size()), nullptr, 0);
+    wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), int(text.size()), &wide[0], length);
+    return wide;
+}
+
+string toUtf8(const wchar_t* text, int length) {
+    int size = WideCharToMultiByte(CP_UTF8, 0, text, length, nullptr, 0, nullptr, nullptr);
+    string utf8(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text, length, &utf8[0], size, nullptr, nullptr);
+    return utf8;
+}
+#endif
+
+namespace {
+
+#if defined(_WIN32) || defined(_WIN64)
+
+class WindowsBackend : public FsBackend {
+public:
+    // FindFirstFile works on paths, so a folder only remembers where it is
+    class WinDirectory : public Directory {
+    public:
+        explicit WinDirectory(string path) : path(move(path)) {}
+        string path;
+    };
+
+    char separator() const override { return '\\'; }
+
+    vector<string> roots() const override {
+        vector<string> drives;
+        WCHAR driveList[MAX_PATH];
+        if (GetLogicalDriveStringsW(MAX_PATH, driveList) == 0) return drives;
+
+        for (WCHAR* drive = driveList; *drive; drive += wcslen(drive) + 1)
+            drives.push_back(string(1, char(toupper(char(drive[0])))) + ":\\");
+        return drives;
+    }
+
+    DirectoryRef open(const DirectoryRef&, const string&, const string& path) const override {
+        return make_shared<WinDirectory>(path);
+    }
+
+    void list(const DirectoryRef& dir, const EntryCallback& onEntry) const override {
+        const string& path = static_cast<const WinDirectory&>(*dir).path;
+        wstring pattern = toWide(join(path, "*"));
+
+        WIN32_FIND_DATAW data;
+        HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch,
+                                       nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE) return;
+
+        string name;
+        do {
+            const WCHAR* wideName = data.cFileName;
+            if (!wcscmp(wideName, L".") || !wcscmp(wideName, L"..")) continue;
+            name = toUtf8(wideName, int(wcslen(wideName)));
+
+            // Junctions and symlinked folders would walk the same tree twice
+            bool isDir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                         && !(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT);
+            FileAttributes attributes;
+            attributes.mtime = ticksOf(data.ftLastWriteTime);
+            attributes.size = isDir ? 0 : (int64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+            onEntry(name, isDir, attributes);
+        } while (FindNextFileW(find, &data));
+
+        FindClose(find);
+    }
+
+    bool stamp(const DirectoryRef& dir, DirStamp& out) const override {
+        const string& path = static_cast<const WinDirectory&>(*dir).path;
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(toWide(path).c_str(), GetFileExInfoStandard, &data)) return false;
+
+        // NTFS updates a folder's write time when an entry is added, removed or renamed
+        out.mtime = ticksOf(data.ftLastWriteTime);
+        out.size = 0;
+        return true;
+    }
+
+    bool attributesOf(const string& path, FileAttributes& out) const override {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(toWide(path).c_str(), GetFileExInfoStandard, &data)) return false;
+
+        out.mtime = ticksOf(data.ftLastWriteTime);
+        out.size = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                       ? 0 : (int64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        return true;
+    }
+
+    int64_t now() const override {
+        FILETIME time;
+        GetSystemTimeAsFileTime(&time);
+        return ticksOf(time);
+    }
+
+private:
+    static int64_t ticksOf(const FILETIME& time) {
+        return (int64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    }
+};
+
+#else
+
+class PosixBackend : public FsBackend {
+public:
+    class PosixDirectory : public Directory {
+    public:
+        explicit PosixDirectory(DIR* dir) : dir(dir) {}
+        ~PosixDirectory() override { closedir(dir); }
+        DIR* dir;
+    };
+
+    explicit PosixBackend(bool listAttributes) : listAttributes(listAttributes) {}
+
+    char separator() const override { return '/'; }
+
+    vector<string> roots() const override { return { "/" }; }
+
+    DirectoryRef open(const DirectoryRef& parent, const string& name, const string& path) const override {
+        const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+        int fd = -1;
+        if (parent) {
+            // Kernel file systems under / are not worth indexing
+            if (path.size() == name.size() + 1 && isPseudoFileSystem(name)) return nullptr;
+            fd = openat(dirfd(static_cast<const PosixDirectory&>(*parent).dir), name.c_str(), flags);
+        } else {
+            fd = ::open(path.c_str(), flags);
+        }
+        if (fd < 0) return nullptr;
+
+        DIR* dir = fdopendir(fd);
+        if (!dir) {
+            close(fd);
+            return nullptr;
+        }
+        return make_shared<PosixDirectory>(dir);
+    }
+
+    void list(const DirectoryRef& ref, const EntryCallback& onEntry) const override {
+        DIR* dir = static_cast<const PosixDirectory&>(*ref).dir;
+
+        // glibc's readdir fills its buffer with getdents64, one call per few hundred entries
+        struct dirent* d = nullptr;
+        while ((d = readdir(dir)) != nullptr) {
+            const char* name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            // Size and time are not in the listing, a stat has them and fills in an empty d_type
+            bool isDir = d->d_type == DT_DIR;
+            FileAttributes attributes;
+            if (d->d_type == DT_UNKNOWN || (listAttributes && !isDir)) {
+                struct stat st;
+                if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                    isDir = S_ISDIR(st.st_mode);
+                    if (listAttributes && !isDir) {
+                        attributes.mtime = mtimeOf(st);
+                        attributes.size = int64_t(st.st_size);
+                    }
+                }
+            }
+            onEntry(name, isDir, attributes);
+        }
+    }
+
+    bool stamp(const DirectoryRef& ref, DirStamp& out) const override {
+        struct stat st;
+        if (fstat(dirfd(static_cast<const PosixDirectory&>(*ref).dir), &st) != 0) return false;
+
+        out.mtime = mtimeOf(st);
+        out.size = st.st_size;
+        return true;
+    }
+
+    bool attributesOf(const string& path, FileAttributes& out) const override {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) return false;
+
+        out.mtime = mtimeOf(st);
+        out.size = S_ISDIR(st.st_mode) ? 0 : int64_t(st.st_size);
+        return true;
+    }
+
+    int64_t now() const override {
+        struct timespec time;
+        clock_gettime(CLOCK_REALTIME, &time);
+        return int64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+
+private:
+    static int64_t mtimeOf(const struct stat& st) {
+#if defined(__APPLE__)
+        return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    }
+
+    static bool isPseudoFileSystem(const string& name) {
+        return name == "proc" || name == "sys" || name == "dev" || name == "run";
+    }
+
+    bool listAttributes;
+};
+
+#endif
+
+}
+
+unique_ptr<FsBackend> FsBackend::create([[maybe_unused]] bool listAttributes) {
+#if defined(_WIN32) || defined(_WIN64)
+    return make_unique<WindowsBackend>();
+#else
+    return make_unique<PosixBackend>(listAttributes);
+#endif
+}
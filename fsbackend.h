@@ -0,0 +1,87 @@
+#ifndef FSBACKEND_H
+#define FSBACKEND_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What a folder looked like when it was last listed, adding or removing an entry changes it
+struct DirStamp {
+#if defined(_WIN32) || defined(_WIN64)
+    static constexpr int64_t TicksPerSecond = 10000000; // FILETIME counts 100 ns
+    static constexpr int64_t UnixEpoch = 116444736000000000; // 1970 counted from 1601
+#else
+    static constexpr int64_t TicksPerSecond = 1000000000;
+    static constexpr int64_t UnixEpoch = 0;
+#endif
+
+    int64_t mtime = 0; // 0 means never recorded
+    int64_t size = 0;  // folder size where the file system reports one, 0 otherwise
+
+    bool known() const { return mtime != 0; }
+    bool operator==(const DirStamp& other) const { return mtime == other.mtime && size == other.size; }
+    bool operator!=(const DirStamp& other) const { return !(*this == other); }
+};
+
+// Size and modification time of one entry as its folder listing reported them, mtime in DirStamp ticks
+struct FileAttributes {
+    int64_t mtime = 0; // 0 means the backend had none
+    int64_t size = 0;  // 0 for folders
+
+    bool known() const { return mtime != 0; }
+};
+
+/*
+Directory listing for the scanner, one implementation per platform.
+The POSIX one keeps each folder open and opens its children with openat, so
+listing a folder never builds child paths. It lists from d_type alone, size
+and time cost one fstatat per file and are only read when create() is asked
+for them. The Windows one reads the attributes FindFirstFileExW already
+returns with every entry, size and modification time included.
+*/
+class FsBackend {
+public:
+    // An open folder, children are opened relative to it
+    class Directory {
+    public:
+        virtual ~Directory() = default;
+    };
+    using DirectoryRef = std::shared_ptr<Directory>;
+
+    using EntryCallback = std::function<void(std::string_view name, bool isDir, const FileAttributes& attributes)>;
+
+    virtual ~FsBackend() = default;
+
+    // listAttributes has list() report size and time of files where that costs a stat per entry
+    static std::unique_ptr<FsBackend> create(bool listAttributes = false);
+
+    virtual char separator() const = 0;
+    // Folders a full scan starts from: every drive on Windows, / elsewhere
+    virtual std::vector<std::string> roots() const = 0;
+
+    // Opens name inside parent, or path when there is no parent. Null when it can't be read.
+    virtual DirectoryRef open(const DirectoryRef& parent, const std::string& name, const std::string& path) const = 0;
+    // Every entry except . and .., symlinks are reported as files so the scan never loops.
+    // Folders never have attributes, files may not have them either, see create().
+    virtual void list(const DirectoryRef& dir, const EntryCallback& onEntry) const = 0;
+    // Modification time of an open folder, one call and no listing
+    virtual bool stamp(const DirectoryRef& dir, DirStamp& out) const = 0;
+    // Attributes of one path without listing its folder, for entries the watcher reports
+    virtual bool attributesOf(const std::string& path, FileAttributes& out) const = 0;
+    // Current time in DirStamp::mtime units
+    virtual int64_t now() const = 0;
+
+    // Joins without doubling the separator after a root like C:\ or /
+    std::string join(const std::string& dir, std::string_view name) const;
+};
+
+#if defined(_WIN32) || defined(_WIN64)
+// Paths are UTF-8 everywhere in the index, the W functions of the Windows API take UTF-16
+std::wstring toWide(const std::string& text);
+std::string toUtf8(const wchar_t* text, int length);
+#endif
+
+#endif // FSBACKEND_H
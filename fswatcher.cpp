@@ -0,0 +1,666 @@
+#include "fswatcher.h"
+#include "fsbackend.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <mntent.h>
+#include <poll.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void FsWatcher::emit(FsEvent event) {
+    static Counter& events = Metrics::counter("watcher.events");
+    static Counter& overflows = Metrics::counter("watcher.overflows");
+    events.add();
+    if (event.kind == FsEvent::Overflow) overflows.add();
+
+    lock_guard<std::mutex> lock(mutex);
+    coalescer.add(move(event));
+}
+
+void FsWatcher::run(const BatchCallback& onBatch) {
+    using Clock = chrono::steady_clock;
+    Clock::time_point burstStart;
+    bool inBurst = false;
+
+    // What is left of a burst after coalescing, events minus delivered is what cancelled out
+    static Counter& batches = Metrics::counter("watcher.batches");
+    static Counter& delivered = Metrics::counter("watcher.delivered");
+    static Histogram& handling = Metrics::histogram("watcher.batch");
+
+    while (!stopped) {
+        if (!poll(PollMs)) break;
+
+        vector<FsEvent> batch;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            if (coalescer.empty()) {
+                inBurst = false;
+                continue;
+            }
+
+            Clock::time_point now = Clock::now();
+            if (!inBurst) {
+                inBurst = true;
+                burstStart = now;
+            }
+            if (coalescer.size() < MaxBatch && now - burstStart < chrono::milliseconds(FlushDelayMs)) continue;
+
+            batch = coalescer.take();
+            inBurst = false;
+        }
+        if (batch.empty()) continue;
+
+        batches.add();
+        delivered.add(batch.size());
+        ScopedTimer timer(handling, "watcher batch");
+        onBatch(batch);
+    }
+}
+
+namespace {
+
+#if defined(_WIN32) || defined(_WIN64)
+
+class WindowsWatcher : public FsWatcher {
+public:
+    WindowsWatcher() : FsWatcher('\\') {}
+
+    // The readers use this, so they are gone before it is
+    ~WindowsWatcher() override {
+        stop();
+        for (Drive& drive : drives) {
+            if (drive.reader.joinable()) drive.reader.join();
+            CloseHandle(drive.dir);
+        }
+    }
+
+    const char* name() const override { return "ReadDirectoryChangesW"; }
+
+    void stop() override {
+        FsWatcher::stop();
+        cancelled = true;
+        for (Drive& drive : drives)
+            CancelIoEx(drive.dir, nullptr);
+    }
+
+protected:
+    bool watch(const vector<string>& paths) override {
+        roots = paths;
+
+        size_t started = 0;
+        for (const string& root : roots) {
+            wstring wideRoot = toWide(root);
+            if (GetDriveTypeW(wideRoot.c_str()) == DRIVE_REMOVABLE) continue;
+
+            HANDLE dir = CreateFileW(wideRoot.c_str(), FILE_LIST_DIRECTORY,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                     FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+            if (dir == INVALID_HANDLE_VALUE) {
+                problem = "can't open " + root;
+                continue;
+            }
+
+            // ReadDirectoryChangesW blocks, so every drive gets its own reader
+            drives.push_back({ dir, root, thread() });
+            ++started;
+        }
+        // Started once the list is complete, stop() may walk it from another thread after that
+        for (Drive& drive : drives)
+            drive.reader = thread(&WindowsWatcher::monitor, this, drive.dir, drive.root);
+        return started > 0;
+    }
+
+    bool poll(int timeoutMs) override {
+        this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+        return true;
+    }
+
+private:
+    static bool isDirectory(const string& path) {
+        DWORD attr = GetFileAttributesW(toWide(path).c_str());
+        return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+    }
+
+    // Starts the next read into buffer, growing it first when an overflow asked for more room
+    static bool startRead(HANDLE dir, vector<DWORD>& buffer, size_t& bufferBytes, OVERLAPPED& overlapped) {
+        while (true) {
+            if (buffer.size() * sizeof(DWORD) < bufferBytes)
+                buffer.resize(bufferBytes / sizeof(DWORD));
+
+            ResetEvent(overlapped.hEvent);
+            if (ReadDirectoryChangesW(dir, buffer.data(), DWORD(buffer.size() * sizeof(DWORD)), TRUE,
+                                      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME, nullptr,
+                                      &overlapped, nullptr))
+                return true;
+
+            // Network shares refuse buffers above 64 KB
+            if (GetLastError() != ERROR_INVALID_PARAMETER || bufferBytes <= MinBufferBytes) return false;
+            bufferBytes = MinBufferBytes;
+            buffer.resize(bufferBytes / sizeof(DWORD));
+        }
+    }
+
+    void parse(const string& root, const BYTE* data, string& oldPath) {
+        auto* fni = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(data);
+        while (true) {
+            string path = root + toUtf8(fni->FileName, int(fni->FileNameLength / sizeof(WCHAR)));
+
+            switch (fni->Action) {
+            case FILE_ACTION_ADDED:
+                emit({ FsEvent::Created, path, {}, isDirectory(path) });
+                break;
+            case FILE_ACTION_REMOVED:
+                // Too late to ask what it was, as a folder it at least takes pending children with it
+                emit({ FsEvent::Deleted, path, {}, true });
+                break;
+            case FILE_ACTION_RENAMED_OLD_NAME:
+                oldPath = move(path);
+                break;
+            case FILE_ACTION_RENAMED_NEW_NAME:
+                emit({ FsEvent::Renamed, path, oldPath, isDirectory(path) });
+                break;
+            default:
+                break;
+            }
+
+            if (fni->NextEntryOffset == 0) break;
+            fni = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const BYTE*>(fni)
+                                                                   + fni->NextEntryOffset);
+        }
+    }
+
+    /*
+    Two buffers: as soon as one read completes the next one is started on the
+    other buffer, and only then are the finished notifications parsed, so the
+    drive is never unwatched while paths are converted and typed.
+    */
+    void monitor(HANDLE dir, string root) {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        vector<DWORD> buffers[2];
+        size_t bufferBytes = MinBufferBytes;
+        int current = 0;
+        string oldPath;
+
+        bool reading = overlapped.hEvent && !cancelled && startRead(dir, buffers[current], bufferBytes, overlapped);
+        if (reading && cancelled) CancelIoEx(dir, &overlapped);
+        while (reading) {
+            DWORD bytesReturned = 0;
+            bool ok = GetOverlappedResult(dir, &overlapped, &bytesReturned, TRUE);
+            if (!ok && GetLastError() != ERROR_NOTIFY_ENUM_DIR) break;
+
+            // A zero sized result or ERROR_NOTIFY_ENUM_DIR means the changes did not fit and are lost
+            bool overflowed = !ok || bytesReturned == 0;
+            if (overflowed && bufferBytes < MaxBufferBytes)
+                bufferBytes *= 2;
+
+            int done = current;
+            current ^= 1;
+            // A read started just after stop() cancelled the previous one would never end
+            reading = !cancelled && startRead(dir, buffers[current], bufferBytes, overlapped);
+            if (reading && cancelled) CancelIoEx(dir, &overlapped);
+
+            if (overflowed)
+                emit({ FsEvent::Overflow, root, {}, true });
+            else
+                parse(root, reinterpret_cast<const BYTE*>(buffers[done].data()), oldPath);
+        }
+
+        if (overlapped.hEvent) CloseHandle(overlapped.hEvent);
+    }
+
+    static constexpr size_t MinBufferBytes = 64 * 1024;
+    static constexpr size_t MaxBufferBytes = 1024 * 1024;
+
+    // One watched drive, the handle stays open until the reader was joined so stop() can cancel it
+    struct Drive {
+        HANDLE dir;
+        string root;
+        thread reader;
+    };
+
+    vector<Drive> drives;
+    atomic<bool> cancelled{ false };
+};
+
+#else
+
+// Same folders the scanner leaves out
+bool isPseudoPath(const string& path) {
+    for (const char* skipped : { "/proc", "/sys", "/dev", "/run" }) {
+        size_t length = strlen(skipped);
+        if (path.compare(0, length, skipped) == 0 && (path.size() == length || path[length] == '/')) return true;
+    }
+    return false;
+}
+
+/*
+Walks everything below folder. onFolder runs before a folder is listed and
+returns false to leave it out, onEntry gets every entry of the listed folders.
+*/
+void walkTree(const FsBackend& backend, const string& folder, const function<bool(const string& path)>& onFolder,
+              const function<void(const string& path, bool isDir)>& onEntry) {
+    struct Pending {
+        FsBackend::DirectoryRef parent;
+        string path;
+        size_t nameStart;
+    };
+
+    vector<Pending> stack;
+    stack.push_back({ nullptr, folder, 0 });
+    while (!stack.empty()) {
+        Pending next = move(stack.back());
+        stack.pop_back();
+
+        FsBackend::DirectoryRef dir = backend.open(next.parent, next.path.substr(next.nameStart), next.path);
+        if (!dir || !onFolder(next.path)) continue;
+
+        backend.list(dir, [&](string_view name, bool isDir, const FileAttributes&) {
+            string path = backend.join(next.path, name);
+            onEntry(path, isDir);
+            if (isDir) {
+                size_t nameStart = path.size() - name.size();
+                stack.push_back({ dir, move(path), nameStart });
+            }
+        });
+    }
+}
+
+#if defined(FAN_RENAME) && defined(FAN_REPORT_DFID_NAME)
+
+/*
+One fanotify mark per file system instead of one watch per folder.
+Events carry the handle of the parent folder plus the entry name, the handle
+is turned back into a path through a descriptor for the mount and cached.
+Needs CAP_SYS_ADMIN and Linux 5.17 for FAN_RENAME.
+*/
+class FanotifyWatcher : public FsWatcher {
+public:
+    FanotifyWatcher() : FsWatcher('/'), backend(FsBackend::create()) {}
+
+    ~FanotifyWatcher() override {
+        if (fd >= 0) close(fd);
+        for (const auto& mount : mounts)
+            close(mount.second);
+    }
+
+    const char* name() const override { return "fanotify"; }
+
+protected:
+    bool watch(const vector<string>& paths) override {
+        roots = paths;
+        fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                           O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+        if (fd < 0) return false;
+
+        for (const string& root : roots) {
+            if (!markFileSystem(root)) return false;
+        }
+
+        // The scanner crosses mount points, so every real file system below the roots needs its own mark
+        FILE* table = setmntent("/proc/self/mounts", "r");
+        if (!table) return true;
+        while (struct mntent* entry = getmntent(table)) {
+            string mountPoint = entry->mnt_dir;
+            if (isPseudoPath(mountPoint) || !isBelowRoot(mountPoint)) continue;
+            if (!markFileSystem(mountPoint))
+                problem = "not watching " + mountPoint;
+        }
+        endmntent(table);
+        return true;
+    }
+
+    bool poll(int timeoutMs) override {
+        struct pollfd p = { fd, POLLIN, 0 };
+        int ready = ::poll(&p, 1, timeoutMs);
+        if (ready <= 0) return ready == 0 || errno == EINTR;
+
+        alignas(struct fanotify_event_metadata) char buffer[65536];
+        while (true) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) return length == 0 || errno == EAGAIN || errno == EINTR;
+
+            auto* event = reinterpret_cast<struct fanotify_event_metadata*>(buffer);
+            for (; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+                if (event->vers != FANOTIFY_METADATA_VERSION) return false;
+                handle(*event);
+            }
+        }
+    }
+
+private:
+    static uint64_t fsidKey(const void* fsid) {
+        uint64_t key;
+        memcpy(&key, fsid, sizeof(key));
+        return key;
+    }
+
+    bool isWatched(const string& path) const { return !path.empty() && !isPseudoPath(path) && isBelowRoot(path); }
+
+    bool isBelowRoot(const string& path) const {
+        for (const string& root : roots) {
+            if (path.compare(0, root.size(), root) == 0
+                && (path.size() == root.size() || root.back() == '/' || path[root.size()] == '/'))
+                return true;
+        }
+        return false;
+    }
+
+    bool markFileSystem(const string& path) {
+        struct statfs info;
+        if (statfs(path.c_str(), &info) != 0) return false;
+        uint64_t fsid = fsidKey(&info.f_fsid);
+        if (mounts.count(fsid)) return true;
+
+        if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_CREATE | FAN_DELETE | FAN_RENAME | FAN_ONDIR,
+                          AT_FDCWD, path.c_str()) != 0)
+            return false;
+
+        int mountFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mountFd < 0) return false;
+        mounts[fsid] = mountFd;
+        return true;
+    }
+
+    // Full path of the entry an info record names, empty when its folder is already gone
+    string resolve(const struct fanotify_event_info_fid& info) {
+        auto* handle = reinterpret_cast<const struct file_handle*>(info.handle);
+        const char* name = reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes);
+
+        string key(reinterpret_cast<const char*>(&info.fsid), sizeof(info.fsid));
+        key.append(reinterpret_cast<const char*>(handle), sizeof(*handle) + handle->handle_bytes);
+
+        auto cached = folders.find(key);
+        if (cached == folders.end()) {
+            auto mount = mounts.find(fsidKey(&info.fsid));
+            if (mount == mounts.end()) return string();
+
+            int dirFd = open_by_handle_at(mount->second, const_cast<struct file_handle*>(handle), O_PATH | O_CLOEXEC);
+            if (dirFd < 0) return string();
+
+            char link[PATH_MAX];
+            ssize_t length = readlink(("/proc/self/fd/" + to_string(dirFd)).c_str(), link, sizeof(link));
+            close(dirFd);
+            if (length <= 0) return string();
+
+            if (folders.size() >= MaxCachedFolders) folders.clear();
+            cached = folders.emplace(move(key), string(link, size_t(length))).first;
+        }
+
+        if (!strcmp(name, ".")) return cached->second;
+        string path = cached->second;
+        if (path.back() != '/') path += '/';
+        return path + name;
+    }
+
+    void handle(const struct fanotify_event_metadata& event) {
+        if (event.mask & FAN_Q_OVERFLOW) {
+            for (const string& root : roots)
+                emit({ FsEvent::Overflow, root, {}, true });
+            return;
+        }
+
+        string path;
+        string oldPath;
+        const char* record = reinterpret_cast<const char*>(&event) + event.metadata_len;
+        const char* end = reinterpret_cast<const char*>(&event) + event.event_len;
+        while (record + sizeof(struct fanotify_event_info_header) <= end) {
+            auto* info = reinterpret_cast<const struct fanotify_event_info_fid*>(record);
+            if (info->hdr.len == 0) break;
+
+            switch (info->hdr.info_type) {
+            case FAN_EVENT_INFO_TYPE_DFID_NAME:
+            case FAN_EVENT_INFO_TYPE_NEW_DFID_NAME:
+                path = resolve(*info);
+                break;
+            case FAN_EVENT_INFO_TYPE_OLD_DFID_NAME:
+                oldPath = resolve(*info);
+                break;
+            default:
+                break;
+            }
+            record += info->hdr.len;
+        }
+        bool isDir = event.mask & FAN_ONDIR;
+        if (event.mask & FAN_RENAME) {
+            // Cached folder paths below a renamed folder are stale now
+            if (isDir) folders.clear();
+
+            // The mark covers the whole file system, moves across the edge of the roots are creates or deletes
+            bool from = isWatched(oldPath);
+            bool to = isWatched(path);
+            if (from && to)
+                emit({ FsEvent::Renamed, path, oldPath, isDir });
+            else if (to)
+                announce(path, isDir);
+            else if (from)
+                emit({ FsEvent::Deleted, oldPath, {}, isDir });
+            return;
+        }
+
+        if (!isWatched(path)) return;
+        if (event.mask & FAN_CREATE) {
+            emit({ FsEvent::Created, path, {}, isDir });
+        } else if (event.mask & FAN_DELETE) {
+            emit({ FsEvent::Deleted, path, {}, isDir });
+        }
+    }
+
+    // Something moved in from outside the roots, its contents are new as well
+    void announce(const string& path, bool isDir) {
+        emit({ FsEvent::Created, path, {}, isDir });
+        if (isDir) {
+            walkTree(*backend, path, [](const string&) { return true; },
+                     [&](const string& entry, bool entryIsDir) { emit({ FsEvent::Created, entry, {}, entryIsDir }); });
+        }
+    }
+
+    static constexpr size_t MaxCachedFolders = 65536;
+
+    unique_ptr<FsBackend> backend;
+
+    int fd = -1;
+    unordered_map<uint64_t, int> mounts;       // fsid -> descriptor handles are opened against
+    unordered_map<string, string> folders;     // fsid and handle -> folder path
+};
+
+#endif
+
+/*
+One inotify watch per folder, added by walking the tree once at startup and
+for every folder created or moved in later. Renames arrive as a
+MOVED_FROM / MOVED_TO pair sharing a cookie, a MOVED_FROM still alone after
+the next read moved out of the watched tree and counts as a delete.
+*/
+class InotifyWatcher : public FsWatcher {
+public:
+    InotifyWatcher() : FsWatcher('/'), backend(FsBackend::create()) {}
+
+    ~InotifyWatcher() override {
+        if (fd >= 0) close(fd);
+    }
+
+    const char* name() const override { return "inotify"; }
+
+protected:
+    bool watch(const vector<string>& paths) override {
+        roots = paths;
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return false;
+
+        for (const string& root : roots)
+            addTree(root, false);
+        return !folders.empty();
+    }
+
+    bool poll(int timeoutMs) override {
+        struct pollfd p = { fd, POLLIN, 0 };
+        int ready = ::poll(&p, 1, timeoutMs);
+        if (ready < 0) return errno == EINTR;
+        if (ready == 0) {
+            // Quiet long enough that no MOVED_TO is coming for what is left
+            expireMoves(true);
+            return true;
+        }
+
+        alignas(struct inotify_event) char buffer[65536];
+        while (true) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) return length == 0 || errno == EAGAIN || errno == EINTR;
+
+            for (char* p = buffer; p < buffer + length;) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                handle(*event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+            expireMoves(false);
+        }
+    }
+
+private:
+    struct Move {
+        string path;
+        bool isDir;
+    };
+
+    static constexpr uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR
+                                          | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+    static bool isBelow(const string& path, const string& folder) {
+        return path.size() > folder.size() && path.compare(0, folder.size(), folder) == 0
+               && (folder.back() == '/' || path[folder.size()] == '/');
+    }
+
+    // Watches folder and everything below it, announce reports what is already inside as created
+    void addTree(const string& folder, bool announce) {
+        walkTree(*backend, folder,
+                 [&](const string& path) {
+                     int wd = inotify_add_watch(fd, path.c_str(), WatchMask);
+                     if (wd < 0) {
+                         if (errno == ENOSPC) problem = "out of inotify watches, raise fs.inotify.max_user_watches";
+                         return false;
+                     }
+                     folders[wd] = path;
+                     return true;
+                 },
+                 [&](const string& path, bool isDir) {
+                     if (announce) emit({ FsEvent::Created, path, {}, isDir });
+                 });
+    }
+
+    // A folder moved inside the tree keeps its watches, only their paths change
+    void renameFolders(const string& oldPath, const string& newPath) {
+        for (auto& folder : folders) {
+            if (folder.second == oldPath)
+                folder.second = newPath;
+            else if (isBelow(folder.second, oldPath))
+                folder.second = newPath + folder.second.substr(oldPath.size());
+        }
+    }
+
+    void forgetFolders(const string& path) {
+        for (auto it = folders.begin(); it != folders.end();) {
+            if (it->second == path || isBelow(it->second, path)) {
+                inotify_rm_watch(fd, it->first);
+                it = folders.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Moves left over from the read before this one went somewhere unwatched
+    void expireMoves(bool all) {
+        for (const auto& pending : previousMoves) {
+            emit({ FsEvent::Deleted, pending.second.path, {}, pending.second.isDir });
+            if (pending.second.isDir) forgetFolders(pending.second.path);
+        }
+        previousMoves.clear();
+        previousMoves.swap(moves);
+        if (all) expireMoves(false);
+    }
+
+    void handle(const struct inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            for (const string& root : roots)
+                emit({ FsEvent::Overflow, root, {}, true });
+            return;
+        }
+
+        auto folder = folders.find(event.wd);
+        if (folder == folders.end()) return;
+        if (event.mask & IN_IGNORED) {
+            folders.erase(folder);
+            return;
+        }
+        if (event.len == 0) return;
+
+        bool isDir = event.mask & IN_ISDIR;
+        string path = backend->join(folder->second, event.name);
+
+        if (event.mask & IN_CREATE) {
+            emit({ FsEvent::Created, path, {}, isDir });
+            if (isDir) addTree(path, true); // entries created before the watch was in place
+        } else if (event.mask & IN_DELETE) {
+            emit({ FsEvent::Deleted, path, {}, isDir });
+        } else if (event.mask & IN_MOVED_FROM) {
+            moves[event.cookie] = { path, isDir };
+        } else if (event.mask & IN_MOVED_TO) {
+            auto& source = moves.count(event.cookie) ? moves : previousMoves;
+            auto from = source.find(event.cookie);
+
+            if (from != source.end()) {
+                emit({ FsEvent::Renamed, path, from->second.path, isDir });
+                if (isDir) renameFolders(from->second.path, path);
+                source.erase(from);
+            } else {
+                emit({ FsEvent::Created, path, {}, isDir });
+                if (isDir) addTree(path, true);
+            }
+        }
+    }
+
+    unique_ptr<FsBackend> backend;
+    int fd = -1;
+    unordered_map<int, string> folders; // watch descriptor -> folder path
+    unordered_map<uint32_t, Move> moves;         // cookie -> MOVED_FROM of the current read
+    unordered_map<uint32_t, Move> previousMoves; // cookie -> MOVED_FROM of the read before
+};
+
+#endif
+
+}
+
+unique_ptr<FsWatcher> FsWatcher::create(const vector<string>& roots) {
+    vector<unique_ptr<FsWatcher>> candidates;
+#if defined(_WIN32) || defined(_WIN64)
+    candidates.push_back(make_unique<WindowsWatcher>());
+#else
+#if defined(FAN_RENAME) && defined(FAN_REPORT_DFID_NAME)
+    candidates.push_back(make_unique<FanotifyWatcher>());
+#endif
+    candidates.push_back(make_unique<InotifyWatcher>());
+#endif
+
+    for (auto& watcher : candidates) {
+        if (watcher->watch(roots)) return move(watcher);
+    }
+    return nullptr;
+}
@@ -0,0 +1,60 @@
+#ifndef FSWATCHER_H
+#define FSWATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "eventcoalescer.h"
+
+/*
+Reports created, deleted and renamed entries below a set of roots, one
+implementation per platform: ReadDirectoryChangesW on Windows, fanotify
+with directory handles and names on Linux when the kernel and privileges
+allow it, and a recursive inotify watch otherwise.
+Events are coalesced and handed out in batches, so a burst like unpacking
+an archive turns into one batch instead of thousands of single updates.
+*/
+class FsWatcher {
+public:
+    using BatchCallback = std::function<void(std::vector<FsEvent>& batch)>;
+
+    // A burst is handed out this long after its first event, or once it is this large
+    static constexpr int FlushDelayMs = 250;
+    static constexpr size_t MaxBatch = 4096;
+    static constexpr int PollMs = 50;
+
+    virtual ~FsWatcher() = default;
+
+    // Watches everything below roots with the best backend available, null when none works
+    static std::unique_ptr<FsWatcher> create(const std::vector<std::string>& roots);
+
+    virtual const char* name() const = 0;
+    // Why part of the tree is not watched, empty when all of it is
+    const std::string& warning() const { return problem; }
+
+    // Reads events until stop is called and passes each batch to onBatch on the calling thread
+    void run(const BatchCallback& onBatch);
+    virtual void stop() { stopped = true; }
+
+protected:
+    explicit FsWatcher(char separator) : coalescer(separator) {}
+
+    // Starts watching below roots, false when nothing could be watched
+    virtual bool watch(const std::vector<std::string>& roots) = 0;
+    // Waits up to timeoutMs for events and emits them, false on an error the watcher can't recover from
+    virtual bool poll(int timeoutMs) = 0;
+    void emit(FsEvent event);
+
+    std::vector<std::string> roots;
+    std::string problem;
+
+private:
+    std::mutex mutex; // emit may be called from reader threads
+    EventCoalescer coalescer;
+    std::atomic<bool> stopped{ false };
+};
+
+#endif // FSWATCHER_H
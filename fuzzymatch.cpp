@@ -0,0 +1,115 @@
+#include "fuzzymatch.h"
+#include "fileindex.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// The weights fzf uses, a name start counts like the start of a path component
+const int ScoreMatch = 16;
+const int GapStart = -3;
+const int GapExtension = -1;
+const int BonusNameStart = 10;
+const int BonusBoundary = 8;  // after _ - . or a space
+const int BonusNonWord = 8;   // the separator itself
+const int BonusCamel = 7;     // lower to upper case, or into a run of digits
+const int BonusConsecutive = 4;
+const int FirstCharMultiplier = 2;
+
+enum CharClass { NameStart, Separator, Lower, Upper, Digit, Other };
+
+CharClass classOf(char c) {
+    if (c >= 'a' && c <= 'z') return Lower;
+    if (c >= 'A' && c <= 'Z') return Upper;
+    if (c >= '0' && c <= '9') return Digit;
+    if (c == '_' || c == '-' || c == '.' || c == ' ' || c == '/' || c == '\\') return Separator;
+    return Other;
+}
+
+int bonusFor(CharClass previous, CharClass current) {
+    if (current == Separator) return BonusNonWord;
+    if (previous == NameStart) return BonusNameStart;
+    if (previous == Separator) return BonusBoundary;
+    if ((previous == Lower && current == Upper) || (previous != Digit && current == Digit)) return BonusCamel;
+    return 0;
+}
+
+uint32_t bitOf(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return 1u << (c - 'a');
+    if (c >= '0' && c <= '9') return 1u << (26 + (c - '0') / 5);
+    if (c == '.') return 1u << 28;
+    if (c == '_' || c == '-' || c == ' ') return 1u << 29;
+    if (c >= 0x80) return 1u << 31;
+    return 1u << 30;
+}
+
+}
+
+uint32_t FuzzyMatch::charMask(string_view folded) {
+    uint32_t mask = 0;
+    for (char c : folded)
+        mask |= bitOf(static_cast<unsigned char>(c));
+    return mask;
+}
+
+string FuzzyMatch::pattern(string_view text) {
+    string out;
+    out.reserve(text.size());
+    for (char c : text)
+        if (c != ' ') out += c;
+    FileIndex::foldCase(out);
+    return out;
+}
+
+int FuzzyMatch::score(string_view name, string_view folded, string_view pattern) {
+    if (pattern.empty() || pattern.size() > folded.size()) return NoMatch;
+
+    // Forward to the first place the whole pattern has been seen
+    size_t matched = 0;
+    size_t end = 0;
+    for (size_t i = 0; i < folded.size(); ++i) {
+        if (folded[i] == pattern[matched] && ++matched == pattern.size()) {
+            end = i + 1;
+            break;
+        }
+    }
+    if (matched < pattern.size()) return NoMatch;
+
+    // Back from there, which gives the shortest window ending at end
+    size_t start = end;
+    for (size_t left = pattern.size(); start-- > 0;) {
+        if (folded[start] == pattern[left - 1] && --left == 0) break;
+    }
+
+    int total = 0;
+    int firstBonus = 0;
+    size_t consecutive = 0;
+    bool inGap = false;
+    size_t next = 0;
+    CharClass previous = start > 0 ? classOf(name[start - 1]) : NameStart;
+    for (size_t i = start; i < end; ++i) {
+        CharClass current = classOf(name[i]);
+        if (next < pattern.size() && folded[i] == pattern[next]) {
+            int bonus = bonusFor(previous, current);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // A run keeps the bonus of the boundary it started on
+                if (bonus >= BonusBoundary && bonus > firstBonus) firstBonus = bonus;
+                bonus = max({ bonus, firstBonus, BonusConsecutive });
+            }
+            total += ScoreMatch + (next == 0 ? bonus * FirstCharMultiplier : bonus);
+            inGap = false;
+            ++consecutive;
+            ++next;
+        } else {
+            total += inGap ? GapExtension : GapStart;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previous = current;
+    }
+    return total;
+}
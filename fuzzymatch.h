@@ -0,0 +1,33 @@
+#ifndef FUZZYMATCH_H
+#define FUZZYMATCH_H
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+Subsequence matching for abbreviations like "vltrcfg" -> vulture_config.json,
+scored the way fzf does: every matched character counts, gaps cost a little,
+and matches at the start of the name, after _ - . or a space, on a camelCase
+hump or running on from the previous match earn a bonus.
+A 32-bit set of the characters in each name is kept in the index, a name
+missing any character of the pattern is skipped without looking at it.
+*/
+namespace FuzzyMatch {
+
+const int NoMatch = INT32_MIN;
+
+// One bit per letter, two digit groups, '.', word separators, other punctuation and non-ASCII bytes
+uint32_t charMask(std::string_view folded);
+
+// Lower-cased pattern without spaces, so "vulture config" still matches vulture_config.json
+std::string pattern(std::string_view text);
+
+// Score of the tightest match of pattern in name, NoMatch when it is not a subsequence.
+// folded is name lower-cased the way FileIndex::foldCase does it.
+int score(std::string_view name, std::string_view folded, std::string_view pattern);
+
+}
+
+#endif // FUZZYMATCH_H
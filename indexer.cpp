@@ -0,0 +1,524 @@
+#include "indexer.h"
+#include "boundedqueue.h"
+#include "fsbackend.h"
+#include "indexstore.h"
+#include "itembulkloader.h"
+#include "metrics.h"
+#include "reconciler.h"
+#include "workstealing.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDir>
+#include <QDateTime>
+#include <QDebug>
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+#define LOG(msg) cout << msg << endl;
+
+using namespace std;
+
+namespace {
+
+// One scanned folder, its entries share the folder path instead of each holding a copy
+struct FolderListing {
+    string path;
+    int priority = 0; // of the folder itself, keywords never span into a child name
+    string names;     // '\0' after each name
+    string types;     // 'd' or 'f', one per name
+    vector<FileAttributes> attributes; // one per name, from the listing itself
+    DirStamp stamp;   // lets the next start skip listing it again
+};
+
+struct ScanTask {
+    FsBackend::DirectoryRef parent; // kept open so the folder opens relative to it
+    string path;
+    size_t nameStart = 0;
+};
+
+// Folders handed to the writer in one go, sized by entry count
+using ScanBatch = vector<FolderListing>;
+const size_t BatchItems = 4096;
+const size_t QueuedBatches = 16; // the scan waits for the writer past this
+
+// Each worker fills its own batch and only touches the queue when it is full
+struct WorkerBatch {
+    ScanBatch batch;
+    size_t items = 0;
+    uint64_t folders = 0; // listed by this worker over the whole scan
+    uint64_t entries = 0;
+};
+
+void flushBatch(WorkerBatch& pending, BoundedQueue<ScanBatch>& out) {
+    if (pending.batch.empty()) return;
+    {
+        // Time spent here is time the writer is behind
+        static Histogram& waits = Metrics::histogram("scan.batch_queue_wait");
+        ScopedTimer timer(waits, "scan batch queue wait");
+        out.push(move(pending.batch));
+    }
+    pending.batch = ScanBatch();
+    pending.items = 0;
+}
+
+void processDirectory(const FsBackend& backend, WorkStealingScheduler<ScanTask>& scheduler,
+                      unsigned int worker, const ScanTask& task, WorkerBatch& pending,
+                      BoundedQueue<ScanBatch>& out, const atomic<bool>& stopping) {
+    // A stopped walk still pops every queued folder, it just lists none of them
+    if (stopping) return;
+
+    FsBackend::DirectoryRef dir = backend.open(task.parent, task.path.substr(task.nameStart), task.path);
+    if (!dir) return;
+
+    FolderListing listing;
+    listing.path = task.path;
+    listing.priority = getPriorityFromPath(task.path);
+    backend.stamp(dir, listing.stamp);
+
+    backend.list(dir, [&](string_view name, bool isDir, const FileAttributes& attributes) {
+        if (name.find('$') != string_view::npos) return;
+
+        listing.names.append(name.data(), name.size());
+        listing.names.push_back('\0');
+        listing.types.push_back(isDir ? 'd' : 'f');
+        listing.attributes.push_back(attributes);
+
+        if (isDir) {
+            string childPath = backend.join(task.path, name);
+            size_t nameStart = childPath.size() - name.size();
+            scheduler.push(worker, { dir, move(childPath), nameStart });
+        }
+    });
+
+    static Gauge& queued = Metrics::gauge("scan.queued_folders");
+    queued.set(int64_t(scheduler.queuedCount()));
+    ++pending.folders;
+    pending.entries += listing.types.size();
+
+    // Empty folders are kept too, their stamp is worth having
+    pending.items += listing.types.size() + 1;
+    pending.batch.push_back(move(listing));
+    if (pending.items >= BatchItems)
+        flushBatch(pending, out);
+}
+
+// Calls fn(name, type, priority, attributes) for every scanned entry, no path is built
+template <typename Fn>
+void forEachItem(const FolderListing& listing, char separator, Fn fn) {
+    string ownName;
+    const char* name = listing.names.data();
+    for (size_t i = 0; i < listing.types.size(); ++i) {
+        string_view entry(name, strlen(name));
+
+        int priority = listing.priority;
+        if (!priority) {
+            ownName.assign(1, separator);
+            ownName.append(entry.data(), entry.size());
+            priority = getPriorityFromPath(ownName);
+        }
+
+        fn(entry, listing.types[i], priority, listing.attributes[i]);
+        name += entry.size() + 1;
+    }
+}
+
+// Producer side of the scan pipeline, closes out once every folder was listed
+void traverseAllDrives(const FsBackend& backend, unsigned int numThreads, BoundedQueue<ScanBatch>& out,
+                       const atomic<bool>& stopping) {
+    LOG("Traversing...");
+
+    WorkStealingScheduler<ScanTask> scheduler(numThreads);
+    vector<WorkerBatch> pending(scheduler.workerCount());
+
+    for (const string& root : backend.roots())
+        scheduler.seed({ nullptr, root, 0 });
+
+    auto start = chrono::steady_clock::now();
+    scheduler.run([&](unsigned int worker, ScanTask& task) {
+        processDirectory(backend, scheduler, worker, task, pending[worker], out, stopping);
+    });
+    auto end = chrono::steady_clock::now();
+    TraceLog::complete("scan traverse", start, end);
+
+    // Rates over the whole walk, a worker that idled a lot shows up as slow
+    double seconds = max(chrono::duration<double>(end - start).count(), 1e-9);
+    for (unsigned int worker = 0; worker < pending.size(); ++worker) {
+        string prefix = "scan.worker" + to_string(worker);
+        Metrics::gauge(prefix + ".folders_per_second").set(int64_t(pending[worker].folders / seconds));
+        Metrics::gauge(prefix + ".entries_per_second").set(int64_t(pending[worker].entries / seconds));
+        Metrics::counter("scan.folders").add(pending[worker].folders);
+        Metrics::counter("scan.entries").add(pending[worker].entries);
+    }
+    Metrics::counter("scan.steals").add(scheduler.stealCount());
+
+    for (auto& worker : pending)
+        flushBatch(worker, out);
+    out.close();
+    LOG("Traversal done, " << scheduler.stealCount() << " steals");
+}
+
+QString systemBootTime() {
+#if defined(_WIN32) || defined(_WIN64)
+    ULONGLONG uptimeMillis = GetTickCount64();
+    QDateTime currentTime = QDateTime::currentDateTimeUtc();
+    QDateTime bootTime = currentTime.addMSecs(-static_cast<qint64>(uptimeMillis));
+    return bootTime.toString(Qt::ISODate);
+#else
+    return QString();
+#endif
+}
+
+bool shouldScan(QSqlDatabase& db) {
+    if (!db.open())
+        return true;
+
+    QSqlQuery query(db);
+
+    query.exec(R"(
+        CREATE TABLE IF NOT EXISTS scan_metadata (
+            id INTEGER PRIMARY KEY,
+            last_scan_time TEXT,
+            last_boot_time TEXT,
+            scan_status TEXT
+        )
+    )");
+
+    query.exec("SELECT scan_status FROM scan_metadata WHERE id = 1");
+
+    // A reboot no longer forces a full scan, the stored folder stamps catch what changed
+    if (query.next()) {
+        if (query.value(0).toString() != "complete")
+            return true; // Last scan failed
+    } else {
+        return true; // scan needed
+    }
+
+    return false; // reconcile instead
+}
+
+void recordScan(QSqlDatabase& db) {
+    QSqlQuery query(db);
+    query.prepare(R"(
+        INSERT OR REPLACE INTO scan_metadata
+        (id, last_scan_time, last_boot_time, scan_status)
+        VALUES (1, :scanTime, :bootTime, 'complete')
+    )");
+    query.bindValue(":scanTime", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    query.bindValue(":bootTime", systemBootTime());
+    query.exec();
+}
+
+const string_view HighPriorityKeywords[] = {
+    "\\documents",
+    "\\desktop",
+    "\\downloads",
+    "\\pictures",
+    "\\videos",
+    "\\music",
+    "d:\\",
+    "e:\\","f:\\","g:\\","h:\\","i:\\","j:\\","k:\\","x:\\","y:\\","z:\\"
+};
+
+// Lower-cased, with '/' read as '\\' so the same keywords match POSIX paths
+inline char keywordChar(char c) {
+    if (c >= 'A' && c <= 'Z') return char(c + ('a' - 'A'));
+    return c == '/' ? '\\' : c;
+}
+
+bool containsKeyword(const string& path, string_view keyword) {
+    if (keyword.size() > path.size()) return false;
+    for (size_t start = 0; start + keyword.size() <= path.size(); ++start) {
+        size_t i = 0;
+        while (i < keyword.size() && keywordChar(path[start + i]) == keyword[i])
+            ++i;
+        if (i == keyword.size()) return true;
+    }
+    return false;
+}
+
+}
+
+IndexPaths IndexPaths::in(const QString& folder) {
+    QDir dir(folder);
+    return { dir.filePath("files.db"), dir.filePath("files.snap") };
+}
+
+Indexer::Indexer(FileIndex& index, IndexPaths paths, unsigned int numThreads)
+    : index(index), paths(move(paths)), numThreads(numThreads),
+      connectionName(QString("Indexer-%1").arg(quintptr(this), 0, 16)) {
+    if (this->numThreads == 0) {
+        unsigned int hardware = thread::hardware_concurrency();
+        if (hardware == 0) hardware = 2;
+        this->numThreads = (hardware > 2) ? hardware - 2 : hardware;
+    }
+}
+
+void Indexer::setBackend(shared_ptr<const FsBackend> fileSystem) {
+    backend = move(fileSystem);
+}
+
+shared_ptr<const FsBackend> Indexer::fileSystem() const {
+    if (backend) return backend;
+    return shared_ptr<const FsBackend>(FsBackend::create(listAttributes));
+}
+
+const char* Indexer::sourceName(Source source) {
+    switch (source) {
+    case Source::Snapshot: return "snapshot";
+    case Source::Database: return "database";
+    case Source::Scan: return "scan";
+    case Source::None: break;
+    }
+    return "none";
+}
+
+// Runs fn on a connection of its own, which is gone again once fn returns
+template <typename Fn>
+auto Indexer::withDatabase(Fn fn) {
+    struct Remove {
+        QString name;
+        ~Remove() { QSqlDatabase::removeDatabase(name); }
+    } remove{ connectionName };
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(paths.database);
+    return fn(db);
+}
+
+Indexer::Source Indexer::load() {
+    return withDatabase([this](QSqlDatabase& db) { return loadWith(db); });
+}
+
+Indexer::Source Indexer::open() {
+    return withDatabase([this](QSqlDatabase& db) { return openWith(db); });
+}
+
+void Indexer::scan() {
+    index.clear();
+    withDatabase([this](QSqlDatabase& db) {
+        scanWith(db);
+        return true;
+    });
+}
+
+Indexer::Source Indexer::loadWith(QSqlDatabase& db) {
+    if (shouldScan(db)) return Source::None;
+
+    IndexStore store(db);
+    bool legacy = store.hasLegacySchema();
+
+    // The snapshot is mapped rather than read, opening it only reads it once to check the checksums
+    if (!legacy) {
+        ScopedTimer timer(Metrics::histogram("index.open_snapshot"), "index open snapshot");
+        if (index.openSnapshot(paths.snapshot.toStdString())) return Source::Snapshot;
+        qDebug() << "No usable index snapshot, loading files.db instead";
+        index.clear();
+    }
+
+    vector<DirStamp> stamps;
+    bool loaded;
+    {
+        ScopedTimer timer(Metrics::histogram("index.load_database"), "index load database");
+        loaded = legacy ? store.migrateLegacy(index, numThreads) : store.load(index, numThreads, &stamps);
+    }
+    if (!loaded) {
+        qWarning() << "Stored index unusable";
+        index.clear();
+        return Source::None;
+    }
+    index.setStamps(move(stamps));
+    return Source::Database;
+}
+
+Indexer::Source Indexer::openWith(QSqlDatabase& db) {
+    // The full scan is only the fallback when there is no usable stored index
+    Source source = loadWith(db);
+    if (source == Source::None) {
+        scanWith(db);
+        db.close();
+        return Source::Scan;
+    }
+
+    qDebug() << "Skipping scan, index loaded from" << sourceName(source);
+    // Changes since the snapshot, or a first snapshot for an index that came from files.db
+    bool changed = !stopping && reconcile(db);
+    if (stopping) {
+        db.close();
+        return source;
+    }
+    if (changed || source == Source::Database)
+        index.checkpoint(paths.snapshot.toStdString());
+    recordScan(db);
+    db.close();
+    return source;
+}
+
+// Applies what changed since the stored index was written, folders with the same stamp are not listed.
+// Returns whether anything changed.
+bool Indexer::reconcile(QSqlDatabase& db) {
+    LOG("Reconciling...");
+    ScopedTimer timer(Metrics::histogram("index.reconcile"), "index reconcile");
+    shared_ptr<const FsBackend> files = fileSystem();
+    Reconciler reconciler(index, *files, getPriorityFromPath);
+    reconciler.setStopFlag(&stopping);
+    Reconciler::Changes changes = reconciler.run(numThreads);
+    // A stopped walk missed folders, what it did see would look like removals
+    if (stopping) return false;
+
+    IndexStore store(db);
+    store.ensureSchema();
+    db.transaction();
+
+    for (uint32_t id : changes.removed) {
+        if (stopping) break;
+        string path = index.pathOf(id);
+        if (path.empty()) continue; // went with a removed parent
+        index.removePath(path);
+        store.removePath(QString::fromStdString(path));
+    }
+    // The adds of one listed folder come one after another, its id is only looked up once
+    const char separator = files->separator();
+    string parentPath;
+    uint32_t parent = FileIndex::NoParent;
+    for (const auto& item : changes.added) {
+        if (stopping) break;
+        size_t cut = item.path.rfind(separator);
+        if (cut != string::npos) {
+            string_view folder(item.path.data(), max<size_t>(cut, 1)); // "/" keeps its separator
+            if (folder != parentPath) {
+                parentPath.assign(folder.data(), folder.size());
+                parent = index.find(parentPath);
+            }
+        }
+        if (cut != string::npos && parent != FileIndex::NoParent)
+            index.addChild(parent, string_view(item.path).substr(cut + 1), item.type, item.priority, item.attributes);
+        else
+            index.addPath(item.path, item.type, item.priority, item.attributes);
+        store.insertPath(QString::fromStdString(item.path), item.type, item.priority, item.attributes);
+    }
+    for (const auto& folder : changes.stamps) {
+        if (stopping) break;
+        store.setStamp(QString::fromStdString(folder.first), folder.second);
+        index.setStamp(index.find(folder.first), folder.second);
+    }
+
+    // Half of it would leave stamps that claim folders are up to date
+    if (stopping) {
+        db.rollback();
+        return false;
+    }
+    db.commit();
+    LOG("Checked " << changes.checked << " folders, listed " << changes.listed << ", "
+        << changes.added.size() << " added, " << changes.removed.size() << " removed");
+    return changes.listed > 0;
+}
+
+void Indexer::scanWith(QSqlDatabase& db) {
+    auto start = chrono::high_resolution_clock::now();
+
+    // Rows go to a staging table that replaces items once the scan is complete
+    bool dbOpen = db.open();
+    ItemBulkLoader loader(db);
+    if (dbOpen)
+        dbOpen = loader.begin();
+
+    // Workers scan while this thread writes, each batch is searchable as soon as it is added
+    shared_ptr<const FsBackend> files = fileSystem();
+    BoundedQueue<ScanBatch> batches(QueuedBatches);
+    thread producer([&]() {
+        traverseAllDrives(*files, numThreads, batches, stopping);
+    });
+
+    // Rows are written from the index, so every folder it creates on the way gets a row and an id
+    index.beginBulkLoad();
+    size_t written = 0;
+    uint32_t storedUpTo = 0;
+    vector<DirStamp> stamps; // by index id
+    ScanBatch batch;
+    Histogram& writeTimes = Metrics::histogram("scan.write_batch");
+    Histogram& commitTimes = Metrics::histogram("scan.db_commit");
+    while (!stopping && batches.pop(batch)) {
+        ScopedTimer batchTimer(writeTimes, "scan write batch");
+        for (const FolderListing& listing : batch) {
+            uint32_t folder = index.addPath(listing.path, 'd', listing.priority);
+            if (folder == FileIndex::NoParent) continue;
+            if (folder >= stamps.size()) stamps.resize(size_t(folder) + 1);
+            stamps[folder] = listing.stamp;
+
+            // A folder listed after something below it already has a row from when that created it
+            if (dbOpen && folder < storedUpTo) {
+                loader.setStamp(ItemBulkLoader::rowIdOf(folder), listing.stamp);
+                if (listing.priority != 0)
+                    loader.setPriority(ItemBulkLoader::rowIdOf(folder), listing.priority);
+            }
+
+            // Children go straight below the folder, addFromIndex() builds their rows from the index
+            forEachItem(listing, files->separator(),
+                        [&](string_view name, char type, int priority, const FileAttributes& attributes) {
+                index.addChild(folder, name, type, priority, attributes);
+                ++written;
+            });
+        }
+        if (dbOpen) {
+            uint32_t end = index.endId();
+            loader.addFromIndex(index, storedUpTo, end, &stamps);
+            storedUpTo = end;
+            ScopedTimer commitTimer(commitTimes, "scan db commit");
+            loader.commit();
+        }
+    }
+    // Closing lets a producer blocked on a full queue drop its batch and finish the walk
+    if (stopping) batches.close();
+    producer.join();
+    if (stopping) {
+        LOG("Scan stopped after " << written << " items");
+        return;
+    }
+
+    // Trigram lists are built by all workers once every name is in
+    {
+        ScopedTimer timer(Metrics::histogram("scan.trigrams"), "scan trigrams");
+        index.endBulkLoad(numThreads);
+    }
+    index.setStamps(move(stamps));
+    LOG("Indexed " << written << " items");
+
+    scanStats = ScanStats();
+    scanStats.entries = index.size();
+    scanStats.scanMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    if (dbOpen && loader.finish()) {
+        LOG("Loaded " << loader.rowCount() << " rows, " << qint64(loader.rowsPerSecond()) << " rows/s");
+        scanStats.rows = size_t(loader.rowCount());
+        scanStats.rowsPerSecond = loader.rowsPerSecond();
+        recordScan(db);
+    }
+
+    // The next start maps this instead of loading files.db, the heap copies are dropped on the way
+    if (!index.checkpoint(paths.snapshot.toStdString()))
+        qWarning() << "Writing the index snapshot failed";
+
+    auto end = chrono::high_resolution_clock::now();
+    double totalMs = chrono::duration<double, milli>(end - start).count();
+    Metrics::histogram("scan.total").record(totalMs);
+    LOG("Scan took " << qint64(totalMs) << " ms");
+}
+
+// Called for every scanned entry, so it compares in place instead of lower-casing a copy
+int getPriorityFromPath(const string& path) {
+    for (string_view keyword : HighPriorityKeywords) {
+        if (containsKeyword(path, keyword))
+            return 1; // User file
+    }
+
+    return 0; // System or unknown
+}
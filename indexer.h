@@ -0,0 +1,84 @@
+#ifndef INDEXER_H
+#define INDEXER_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "fileindex.h"
+#include "fsbackend.h"
+
+// Where one index keeps its files
+struct IndexPaths {
+    QString database; // files.db, the source of truth
+    QString snapshot; // base name of the mapped snapshot files
+
+    // files.db and files.snap inside folder
+    static IndexPaths in(const QString& folder);
+};
+
+/*
+Fills a FileIndex and keeps files.db in line with it. A stored index is
+mapped from the snapshot or loaded from files.db, a full scan of every drive
+is only the fallback when neither is usable. Every call opens and closes its
+own connection, so an Indexer can be used from any one thread at a time,
+only stop() may come from another one.
+*/
+class Indexer {
+public:
+    enum class Source { None, Snapshot, Database, Scan };
+
+    // What the last scan() or scanning open() did
+    struct ScanStats {
+        size_t entries = 0;
+        double scanMs = 0;      // listing every folder until the last name is searchable
+        size_t rows = 0;        // written to files.db
+        double rowsPerSecond = 0;
+    };
+
+    // numThreads 0 leaves two hardware threads to the rest of the program
+    Indexer(FileIndex& index, IndexPaths paths, unsigned int numThreads = 0);
+
+    // Scans and reconciles through backend instead of the real file system, used by the benchmarks
+    void setBackend(std::shared_ptr<const FsBackend> backend);
+    // Reads size and time of every file on a scan even where that costs a stat each, see FsBackend::create()
+    void setListAttributes(bool on) { listAttributes = on; }
+    const ScanStats& lastScan() const { return scanStats; }
+
+    // Maps the snapshot or loads files.db without touching the file system. None when there is no stored index.
+    Source load();
+    // Loads and catches up with changes since, or scans when nothing usable is stored
+    Source open();
+    // Lists every drive again and replaces files.db and the snapshot
+    void scan();
+    // Makes a running open() or scan() return soon. The index is left partly filled,
+    // and neither the scan nor the reconcile is recorded, so the next open() repeats it.
+    void stop() { stopping = true; }
+
+    static const char* sourceName(Source source);
+
+private:
+    Source loadWith(QSqlDatabase& db);
+    Source openWith(QSqlDatabase& db);
+    void scanWith(QSqlDatabase& db);
+    bool reconcile(QSqlDatabase& db);
+    std::shared_ptr<const FsBackend> fileSystem() const;
+
+    template <typename Fn>
+    auto withDatabase(Fn fn);
+
+    FileIndex& index;
+    IndexPaths paths;
+    unsigned int numThreads;
+    QString connectionName;
+    std::shared_ptr<const FsBackend> backend; // null for the real file system
+    bool listAttributes = false;
+    ScanStats scanStats;
+    std::atomic<bool> stopping{ false };
+};
+
+// 1 for paths in user folders and on data drives, 0 for everything else
+int getPriorityFromPath(const std::string& path);
+
+#endif // INDEXER_H
@@ -0,0 +1,214 @@
+#include "indexsnapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+const char Magic[8] = { 'V', 'U', 'L', 'T', 'I', 'D', 'X', '\0' };
+const uint32_t Version = 3; // 2: folded names lower-case non-ASCII letters too, 3: unknown sizes are UnknownSize
+const uint32_t ByteOrder = 0x01020304; // reads back differently on a machine of the other endianness
+const uint64_t Alignment = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t generation;
+    uint32_t sectionCount;
+    uint32_t tableCrc; // header with this field zeroed, then the section table
+};
+
+struct SectionEntry {
+    uint32_t id;
+    uint32_t crc;
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+static_assert(sizeof(FileHeader) == 32, "snapshot header layout");
+static_assert(sizeof(SectionEntry) == 24, "snapshot section table layout");
+
+uint32_t crc32(const void* data, size_t bytes, uint32_t crc = 0) {
+    static const auto table = []() {
+        array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < bytes; ++i)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t tableCrc(FileHeader header, const SectionEntry* entries) {
+    header.tableCrc = 0;
+    uint32_t crc = crc32(&header, sizeof(header));
+    return crc32(entries, header.sectionCount * sizeof(SectionEntry), crc);
+}
+
+uint64_t alignUp(uint64_t value) {
+    return (value + Alignment - 1) / Alignment * Alignment;
+}
+
+// Existing generations next to basePath, newest first
+vector<pair<uint64_t, string>> generations(const string& basePath) {
+    fs::path base = fs::u8path(basePath);
+    fs::path folder = base.has_parent_path() ? base.parent_path() : fs::path(".");
+    string prefix = base.filename().u8string() + ".";
+
+    vector<pair<uint64_t, string>> found;
+    error_code ec;
+    for (fs::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+        string name = it->path().filename().u8string();
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+
+        string digits = name.substr(prefix.size());
+        if (digits.size() > 19 || !all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            continue; // temporary files and anything else
+        found.emplace_back(stoull(digits), it->path().u8string());
+    }
+    sort(found.rbegin(), found.rend());
+    return found;
+}
+
+}
+
+void SnapshotWriter::add(uint32_t id, const void* data, size_t bytes) {
+    sections.push_back({ id, data, bytes });
+}
+
+bool SnapshotWriter::write(const string& basePath) {
+    vector<pair<uint64_t, string>> existing = generations(basePath);
+    uint64_t generation = existing.empty() ? 1 : existing.front().first + 1;
+    string finalPath = basePath + "." + to_string(generation);
+    string tempPath = finalPath + ".tmp";
+
+    FileHeader header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrder;
+    header.generation = generation;
+    header.sectionCount = uint32_t(sections.size());
+
+    vector<SectionEntry> entries;
+    uint64_t offset = alignUp(sizeof(FileHeader) + sections.size() * sizeof(SectionEntry));
+    for (const Pending& section : sections) {
+        entries.push_back({ section.id, crc32(section.data, section.bytes), offset, section.bytes });
+        offset = alignUp(offset + section.bytes);
+    }
+    header.tableCrc = tableCrc(header, entries.data());
+
+    {
+        ofstream out(fs::u8path(tempPath), ios::binary | ios::trunc);
+        if (!out) return false;
+
+        static const char padding[Alignment] = {};
+        uint64_t written = 0;
+        auto put = [&](const void* data, size_t bytes) {
+            out.write(static_cast<const char*>(data), streamsize(bytes));
+            written += bytes;
+        };
+        auto padTo = [&](uint64_t position) {
+            put(padding, size_t(position - written));
+        };
+
+        put(&header, sizeof(header));
+        put(entries.data(), entries.size() * sizeof(SectionEntry));
+        for (size_t i = 0; i < sections.size(); ++i) {
+            padTo(entries[i].offset);
+            put(sections[i].data, sections[i].bytes);
+        }
+        out.flush();
+        if (!out) {
+            out.close();
+            error_code ec;
+            fs::remove(fs::u8path(tempPath), ec);
+            return false;
+        }
+    }
+
+    error_code ec;
+    fs::rename(fs::u8path(tempPath), fs::u8path(finalPath), ec);
+    if (ec) {
+        fs::remove(fs::u8path(tempPath), ec);
+        return false;
+    }
+
+    // A generation that is still mapped can't be removed on Windows, the next write tries again
+    for (const auto& old : existing)
+        fs::remove(fs::u8path(old.second), ec);
+    return true;
+}
+
+bool SnapshotReader::open(const string& basePath) {
+    for (const auto& candidate : generations(basePath)) {
+        if (openFile(candidate.second)) return true;
+    }
+    mapped.reset();
+    table.clear();
+    current = 0;
+    return false;
+}
+
+bool SnapshotReader::openFile(const string& path) {
+    shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file || file->size() < sizeof(FileHeader)) return false;
+
+    FileHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.byteOrder != ByteOrder)
+        return false;
+
+    uint64_t tableEnd = sizeof(FileHeader) + uint64_t(header.sectionCount) * sizeof(SectionEntry);
+    if (tableEnd > file->size()) return false;
+
+    const SectionEntry* entries = reinterpret_cast<const SectionEntry*>(file->data() + sizeof(FileHeader));
+    if (tableCrc(header, entries) != header.tableCrc) return false;
+
+    vector<Section> sections;
+    for (uint32_t i = 0; i < header.sectionCount; ++i) {
+        const SectionEntry& e = entries[i];
+        // A truncated file must never hand out memory past the mapping
+        if (e.offset % Alignment != 0 || e.offset > file->size() || e.bytes > file->size() - e.offset)
+            return false;
+        sections.push_back({ e.id, e.crc, e.offset, e.bytes });
+    }
+
+    mapped = move(file);
+    table = move(sections);
+    current = header.generation;
+    return true;
+}
+
+bool SnapshotReader::section(uint32_t id, const void*& data, size_t& bytes) const {
+    for (const Section& s : table) {
+        if (s.id != id) continue;
+        data = mapped->data() + s.offset;
+        bytes = size_t(s.bytes);
+        return true;
+    }
+    return false;
+}
+
+bool SnapshotReader::verify() const {
+    if (!mapped) return false;
+    for (const Section& s : table) {
+        if (crc32(mapped->data() + s.offset, size_t(s.bytes)) != s.crc) return false;
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef INDEXSNAPSHOT_H
+#define INDEXSNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+
+/*
+Versioned binary file of raw arrays, laid out so they can be used straight
+from a read-only mapping. A header and a table of sections with their
+offsets and CRC32 checksums lead the file, every section starts 64-byte
+aligned.
+Every write goes to a new file <base>.<generation> through a temporary file
+and a rename, so a crash never leaves a half written snapshot behind and a
+mapped older generation stays valid until it is unmapped.
+*/
+class SnapshotWriter {
+public:
+    // The data has to stay alive until write() returns
+    void add(uint32_t id, const void* data, size_t bytes);
+    // Writes the next generation next to basePath and removes older ones where possible
+    bool write(const std::string& basePath);
+
+private:
+    struct Pending {
+        uint32_t id;
+        const void* data;
+        size_t bytes;
+    };
+
+    std::vector<Pending> sections;
+};
+
+class SnapshotReader {
+public:
+    // Maps the newest generation next to basePath whose header and section table check out.
+    // Section contents are only checked by verify().
+    bool open(const std::string& basePath);
+
+    // False when the snapshot has no such section
+    bool section(uint32_t id, const void*& data, size_t& bytes) const;
+    // Compares the checksum of every section, this reads the whole file
+    bool verify() const;
+
+    const std::shared_ptr<MappedFile>& file() const { return mapped; }
+    uint64_t generation() const { return current; }
+
+private:
+    struct Section {
+        uint32_t id;
+        uint32_t crc;
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    bool openFile(const std::string& path);
+
+    std::shared_ptr<MappedFile> mapped;
+    std::vector<Section> table;
+    uint64_t current = 0;
+};
+
+#endif // INDEXSNAPSHOT_H
@@ -0,0 +1,338 @@
+#include "indexstore.h"
+#include "itembulkloader.h"
+
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Matches FileIndex: Windows names compare case-insensitively
+#if defined(_WIN32) || defined(_WIN64)
+const char* const NameCollation = " COLLATE NOCASE";
+#else
+const char* const NameCollation = "";
+#endif
+
+inline QString toQString(string_view text) {
+    return QString::fromUtf8(text.data(), int(text.size()));
+}
+
+}
+
+IndexStore::IndexStore(QSqlDatabase& db)
+    : db(db), findChild(db), addChild(db), updateChild(db), updateAttributes(db) {}
+
+QString IndexStore::createTableSql(const QString& table) {
+    return QString(R"(
+        CREATE TABLE IF NOT EXISTS %1 (
+            id INTEGER PRIMARY KEY,
+            parent_id INTEGER NOT NULL,
+            name TEXT NOT NULL%2,
+            type TEXT NOT NULL,
+            priority INTEGER DEFAULT 0,
+            mtime INTEGER DEFAULT 0,
+            size INTEGER DEFAULT 0
+        )
+    )").arg(table, NameCollation);
+}
+
+QString IndexStore::createIndexSql(const QString& table) {
+    // Also serves the parent_id lookups of the subtree queries
+    return QString("CREATE UNIQUE INDEX IF NOT EXISTS %1_parent_name ON %1 (parent_id, name)").arg(table);
+}
+
+bool IndexStore::ensureSchema() {
+    QSqlQuery query(db);
+    if (!query.exec(createTableSql("items")) || !query.exec(createIndexSql("items"))) {
+        qWarning() << "Index store schema failed:" << query.lastError().text();
+        return false;
+    }
+
+    // Folder stamps came after the parent id layout
+    bool hasStamps = false;
+    if (query.exec("PRAGMA table_info(items)")) {
+        while (query.next())
+            hasStamps = hasStamps || query.value(1).toString() == "mtime";
+    }
+    if (!hasStamps) {
+        query.exec("ALTER TABLE items ADD COLUMN mtime INTEGER DEFAULT 0");
+        query.exec("ALTER TABLE items ADD COLUMN size INTEGER DEFAULT 0");
+    }
+
+    findChild.prepare("SELECT id FROM items WHERE parent_id = ? AND name = ?");
+    addChild.prepare("INSERT INTO items (parent_id, name, type, priority, mtime, size) VALUES (?, ?, ?, ?, ?, ?)");
+    updateChild.prepare("UPDATE items SET type = ?, priority = ? WHERE id = ?");
+    updateAttributes.prepare("UPDATE items SET mtime = ?, size = ? WHERE id = ?");
+    return true;
+}
+
+bool IndexStore::hasLegacySchema() {
+    QSqlQuery query(db);
+    if (!query.exec("PRAGMA table_info(items)")) return false;
+    while (query.next()) {
+        if (query.value(1).toString() == "path")
+            return true;
+    }
+    return false;
+}
+
+bool IndexStore::migrateLegacy(FileIndex& index, unsigned int numThreads) {
+    qDebug() << "Migrating files.db to parent ids...";
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT path, type, priority FROM items")) {
+        qWarning() << "Legacy read failed:" << query.lastError().text();
+        return false;
+    }
+
+    // The index splits the paths and hands out parent ids, the new rows are written from it
+    index.beginBulkLoad();
+    while (query.next()) {
+        QString type = query.value(1).toString();
+        index.addPath(query.value(0).toString().toStdString(),
+                      type.isEmpty() ? 'f' : type.at(0).toLatin1(),
+                      query.value(2).toInt());
+    }
+    query.finish();
+    index.endBulkLoad(numThreads);
+
+    ItemBulkLoader loader(db);
+    if (!loader.begin()) return false;
+    loader.addFromIndex(index, 0, index.endId());
+    return loader.finish();
+}
+
+bool IndexStore::load(FileIndex& index, unsigned int numThreads, vector<DirStamp>* stamps) {
+    if (!ensureSchema()) return false;
+
+    QSqlQuery query(db);
+    qint64 maxId = 0;
+    if (query.exec("SELECT MAX(id) FROM items") && query.next())
+        maxId = query.value(0).toLongLong();
+
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, parent_id, name, type, priority, mtime, size FROM items ORDER BY id")) {
+        qWarning() << "Index load failed:" << query.lastError().text();
+        return false;
+    }
+
+    struct Row {
+        qint64 id;
+        qint64 parent;
+        string name;
+        char type;
+        int priority;
+        DirStamp stamp; // a folder's stamp, or a file's modification time and size
+    };
+
+    vector<uint32_t> indexIds(size_t(maxId) + 1, FileIndex::NoParent);
+    auto place = [&](const Row& row) {
+        uint32_t parent = FileIndex::NoParent;
+        if (row.parent != 0) {
+            if (row.parent > maxId || indexIds[size_t(row.parent)] == FileIndex::NoParent) return false;
+            parent = indexIds[size_t(row.parent)];
+        }
+        FileAttributes attributes;
+        attributes.mtime = row.stamp.mtime;
+        if (row.type != 'd')
+            attributes.size = row.stamp.size;
+        uint32_t id = index.addChild(parent, row.name, row.type, row.priority, attributes);
+        indexIds[size_t(row.id)] = id;
+        if (stamps && row.type == 'd' && row.stamp.known() && id != FileIndex::NoParent) {
+            if (id >= stamps->size()) stamps->resize(size_t(id) + 1);
+            (*stamps)[id] = row.stamp;
+        }
+        return true;
+    };
+
+    // A folder moved below a newer one comes after its children, those wait for a second pass
+    vector<Row> waiting;
+    index.beginBulkLoad();
+    while (query.next()) {
+        QString type = query.value(3).toString();
+        Row row{ query.value(0).toLongLong(), query.value(1).toLongLong(),
+                 query.value(2).toString().toStdString(),
+                 type.isEmpty() ? 'f' : type.at(0).toLatin1(), query.value(4).toInt(),
+                 { query.value(5).toLongLong(), query.value(6).toLongLong() } };
+        if (!place(row))
+            waiting.push_back(move(row));
+    }
+
+    size_t before = waiting.size() + 1;
+    while (!waiting.empty() && waiting.size() < before) {
+        before = waiting.size();
+        vector<Row> still;
+        for (Row& row : waiting) {
+            if (!place(row))
+                still.push_back(move(row));
+        }
+        waiting.swap(still);
+    }
+    index.endBulkLoad(numThreads);
+
+    if (!waiting.empty())
+        qWarning() << "Index load skipped" << waiting.size() << "orphaned rows";
+    return true;
+}
+
+qint64 IndexStore::childOf(qint64 parent, const QString& name) {
+    findChild.bindValue(0, parent);
+    findChild.bindValue(1, name);
+    qint64 id = 0;
+    if (findChild.exec() && findChild.next())
+        id = findChild.value(0).toLongLong();
+    findChild.finish();
+    return id;
+}
+
+qint64 IndexStore::insertChild(qint64 parent, const QString& name, char type, int priority,
+                               const FileAttributes& attributes) {
+    // A folder's columns are only written with its stamp
+    bool isDir = type == 'd';
+    addChild.bindValue(0, parent);
+    addChild.bindValue(1, name);
+    addChild.bindValue(2, QString(QChar(type)));
+    addChild.bindValue(3, priority);
+    addChild.bindValue(4, qint64(isDir ? 0 : attributes.mtime));
+    addChild.bindValue(5, qint64(isDir ? 0 : attributes.size));
+    if (!addChild.exec()) {
+        qWarning() << "Index store insert failed:" << addChild.lastError().text();
+        return 0;
+    }
+    return addChild.lastInsertId().toLongLong();
+}
+
+qint64 IndexStore::ensureParents(const vector<string_view>& parts) {
+    qint64 parent = 0;
+    for (size_t i = 0; i + 1 < parts.size(); ++i) {
+        QString name = toQString(parts[i]);
+        qint64 id = childOf(parent, name);
+        if (id == 0)
+            id = insertChild(parent, name, 'd', 0);
+        if (id == 0) return -1;
+        parent = id;
+    }
+    return parent;
+}
+
+qint64 IndexStore::idOf(const QString& path) {
+    string text = path.toStdString();
+    qint64 id = 0;
+    for (string_view part : FileIndex::splitPath(text)) {
+        id = childOf(id, toQString(part));
+        if (id == 0) break;
+    }
+    return id;
+}
+
+qint64 IndexStore::insertPath(const QString& path, char type, int priority, const FileAttributes& attributes) {
+    string text = path.toStdString();
+    vector<string_view> parts = FileIndex::splitPath(text);
+    if (parts.empty()) return 0;
+
+    qint64 parent = ensureParents(parts);
+    if (parent < 0) return 0;
+
+    QString name = toQString(parts.back());
+    qint64 id = childOf(parent, name);
+    if (id == 0)
+        return insertChild(parent, name, type, priority, attributes);
+
+    updateChild.bindValue(0, QString(QChar(type)));
+    updateChild.bindValue(1, priority);
+    updateChild.bindValue(2, id);
+    if (!updateChild.exec()) {
+        qWarning() << "Index store update failed:" << updateChild.lastError().text();
+        return 0;
+    }
+
+    if (type != 'd' && attributes.known()) {
+        updateAttributes.bindValue(0, qint64(attributes.mtime));
+        updateAttributes.bindValue(1, qint64(attributes.size));
+        updateAttributes.bindValue(2, id);
+        if (!updateAttributes.exec()) {
+            qWarning() << "Index store update failed:" << updateAttributes.lastError().text();
+            return 0;
+        }
+    }
+    return id;
+}
+
+bool IndexStore::removeSubtree(qint64 id) {
+    QSqlQuery query(db);
+    // UNION rather than UNION ALL, a parent_id loop from an older file can't make it run forever
+    query.prepare(R"(
+        WITH RECURSIVE subtree(id) AS (
+            SELECT ?
+            UNION
+            SELECT items.id FROM items JOIN subtree ON items.parent_id = subtree.id
+        )
+        DELETE FROM items WHERE id IN subtree
+    )");
+    query.addBindValue(id);
+    if (!query.exec()) {
+        qWarning() << "Index store delete failed:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool IndexStore::removePath(const QString& path) {
+    qint64 id = idOf(path);
+    return id != 0 && removeSubtree(id);
+}
+
+bool IndexStore::renamePath(const QString& oldPath, const QString& newPath) {
+    qint64 id = idOf(oldPath);
+    if (id == 0) return false;
+
+    string text = newPath.toStdString();
+    vector<string_view> parts = FileIndex::splitPath(text);
+    if (parts.empty()) return false;
+
+    // A folder moved below itself would make parent_id loop, as FileIndex::renamePath() refuses it
+    qint64 ancestor = 0;
+    for (size_t i = 0; i + 1 < parts.size(); ++i) {
+        ancestor = childOf(ancestor, toQString(parts[i]));
+        if (ancestor == 0) break;
+        if (ancestor == id) return false;
+    }
+
+    qint64 parent = ensureParents(parts);
+    if (parent < 0) return false;
+
+    // Renaming over an existing entry replaces it
+    QString name = toQString(parts.back());
+    qint64 existing = childOf(parent, name);
+    if (existing != 0 && existing != id)
+        removeSubtree(existing);
+
+    QSqlQuery query(db);
+    query.prepare("UPDATE items SET parent_id = ?, name = ? WHERE id = ?");
+    query.addBindValue(parent);
+    query.addBindValue(name);
+    query.addBindValue(id);
+    if (!query.exec()) {
+        qWarning() << "Index store rename failed:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool IndexStore::setStamp(const QString& path, const DirStamp& stamp) {
+    qint64 id = idOf(path);
+    if (id == 0) return false;
+
+    QSqlQuery query(db);
+    query.prepare("UPDATE items SET mtime = ?, size = ? WHERE id = ?");
+    query.addBindValue(stamp.mtime);
+    query.addBindValue(stamp.size);
+    query.addBindValue(id);
+    return query.exec();
+}
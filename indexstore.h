@@ -0,0 +1,65 @@
+#ifndef INDEXSTORE_H
+#define INDEXSTORE_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <string_view>
+#include <vector>
+#include "fileindex.h"
+#include "fsbackend.h"
+
+/*
+The items table in files.db.
+Each row holds its own name and the id of its parent folder (0 for a drive
+or the POSIX root), so a path prefix is stored once however many entries
+share it. Removing or moving a folder touches its own row and the subtree
+follows.
+*/
+class IndexStore {
+public:
+    explicit IndexStore(QSqlDatabase& db);
+
+    static QString createTableSql(const QString& table);
+    static QString createIndexSql(const QString& table);
+
+    // Creates the table when missing, adds columns an older files.db lacks
+    bool ensureSchema();
+    // True for a files.db written before the table had parent ids
+    bool hasLegacySchema();
+    // Rewrites a full-path items table into the parent id layout, filling index on the way
+    bool migrateLegacy(FileIndex& index, unsigned int numThreads);
+
+    // Fills index from the table, parents before children. stamps gets each folder's stamp by index id.
+    bool load(FileIndex& index, unsigned int numThreads, std::vector<DirStamp>* stamps = nullptr);
+
+    // Id of the row for path, 0 when it is not stored
+    qint64 idOf(const QString& path);
+    // Inserts or updates path, missing parent folders are added as directories.
+    // A file's attributes go in the columns a folder keeps its stamp in, unknown ones are left alone.
+    // 0 when a statement failed.
+    qint64 insertPath(const QString& path, char type, int priority = 0,
+                      const FileAttributes& attributes = FileAttributes());
+    // Deletes the row and every row below it
+    bool removePath(const QString& path);
+    // Moves one row, everything below follows without being touched
+    bool renamePath(const QString& oldPath, const QString& newPath);
+    // Remembers what a folder looked like when it was listed
+    bool setStamp(const QString& path, const DirStamp& stamp);
+
+private:
+    qint64 childOf(qint64 parent, const QString& name);
+    qint64 insertChild(qint64 parent, const QString& name, char type, int priority,
+                       const FileAttributes& attributes = FileAttributes());
+    // Folders above the last part, created when missing. -1 on failure.
+    qint64 ensureParents(const std::vector<std::string_view>& parts);
+    bool removeSubtree(qint64 id);
+
+    QSqlDatabase& db;
+    QSqlQuery findChild;
+    QSqlQuery addChild;
+    QSqlQuery updateChild;
+    QSqlQuery updateAttributes;
+};
+
+#endif // INDEXSTORE_H
@@ -0,0 +1,214 @@
+#include "indexwriter.h"
+#include "indexstore.h"
+#include "metrics.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <chrono>
+#include <set>
+
+using namespace std;
+
+namespace {
+
+bool isBelowAny(const set<string>& folders, const string& path) {
+    for (size_t i = path.find(FileIndex::Separator); i != string::npos; i = path.find(FileIndex::Separator, i + 1)) {
+        // The POSIX root has an empty name, "/" itself is the first ancestor
+        size_t length = i == 0 ? 1 : i;
+        if (folders.count(path.substr(0, length))) return true;
+    }
+    return false;
+}
+
+/*
+Drops adds and removes that a later folder remove in the same group undoes,
+so deleting a large folder costs one subtree delete instead of one per file.
+A rename can move a folder out of the way before it is removed again, so the
+search does not look past one.
+*/
+void dropCovered(vector<FileIndex::Change>& group) {
+    set<string> removedLater;
+    vector<bool> covered(group.size(), false);
+    for (size_t i = group.size(); i-- > 0;) {
+        const FileIndex::Change& change = group[i];
+        if (change.kind == FileIndex::Change::Rename) {
+            removedLater.clear();
+            continue;
+        }
+
+        covered[i] = isBelowAny(removedLater, change.path);
+        if (change.kind == FileIndex::Change::Remove && !covered[i])
+            removedLater.insert(change.path);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < group.size(); ++i) {
+        if (!covered[i]) group[kept++] = move(group[i]);
+    }
+    group.resize(kept);
+}
+
+}
+
+IndexWriter::IndexWriter(FileIndex& index, const QString& databasePath, const QString& snapshotPath)
+    : index(index), databasePath(databasePath), snapshotPath(snapshotPath) {}
+
+IndexWriter::~IndexWriter() {
+    stop();
+}
+
+void IndexWriter::start() {
+    if (!writer.joinable())
+        writer = thread(&IndexWriter::run, this);
+}
+
+bool IndexWriter::submit(FileIndex::Change change) {
+    static Gauge& queued = Metrics::gauge("writer.queued");
+    static Counter& dropped = Metrics::counter("writer.dropped");
+    queued.add(1);
+    if (queue.push(move(change))) return true;
+    queued.add(-1);
+    dropped.add();
+    return false;
+}
+
+void IndexWriter::stop() {
+    queue.close();
+    if (writer.joinable())
+        writer.join();
+}
+
+IndexWriter::Stats IndexWriter::stats() const {
+    lock_guard<mutex> guard(statsLock);
+    return totals;
+}
+
+void IndexWriter::run() {
+    const QString connName = "IndexWriter";
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
+        db.setDatabaseName(databasePath);
+        if (!db.open()) {
+            qWarning() << "IndexWriter DB open failed:" << db.lastError().text();
+            FileIndex::Change dropped;
+            while (queue.pop(dropped)) {}
+            return;
+        }
+
+        // WAL lets readers keep their snapshot while a group is written, NORMAL only syncs at checkpoints
+        QSqlQuery pragma(db);
+        pragma.exec("PRAGMA journal_mode = WAL");
+        pragma.exec("PRAGMA synchronous = NORMAL");
+        pragma.exec("PRAGMA busy_timeout = 5000");
+
+        IndexStore store(db);
+        store.ensureSchema();
+
+        vector<FileIndex::Change> group;
+        FileIndex::Change change;
+        QElapsedTimer sinceCheckpoint;
+        sinceCheckpoint.start();
+        bool changedSinceCheckpoint = false;
+        while (queue.pop(change)) {
+            // The first change opens a group, whatever arrives until the deadline joins it
+            auto deadline = chrono::steady_clock::now() + chrono::milliseconds(CommitIntervalMs);
+            group.push_back(move(change));
+            while (group.size() < MaxGroup && queue.popUntil(change, deadline))
+                group.push_back(move(change));
+            Metrics::gauge("writer.queued").add(-int64_t(group.size()));
+
+            commitGroup(db, store, group);
+            group.clear();
+            changedSinceCheckpoint = true;
+
+            if (sinceCheckpoint.elapsed() >= CheckpointIntervalMs) {
+                checkpoint();
+                sinceCheckpoint.restart();
+                changedSinceCheckpoint = false;
+            }
+        }
+        // Quitting with changes the last snapshot misses, the next start would reconcile them otherwise
+        if (changedSinceCheckpoint)
+            checkpoint();
+
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connName);
+}
+
+void IndexWriter::commitGroup(QSqlDatabase& db, IndexStore& store, vector<FileIndex::Change>& group) {
+    QElapsedTimer timer;
+    timer.start();
+    TraceLog::Clock::time_point started = TraceLog::Clock::now();
+
+    size_t submitted = group.size();
+    dropCovered(group);
+
+    db.transaction();
+    for (const FileIndex::Change& change : group) {
+        QString path = QString::fromStdString(change.path);
+
+        switch (change.kind) {
+        case FileIndex::Change::Add:
+            if (store.insertPath(path, change.type, change.priority, change.attributes) == 0)
+                qWarning() << "IndexWriter insert failed:" << path;
+            break;
+        case FileIndex::Change::Remove:
+            // A removed folder takes its whole subtree with it
+            store.removePath(path);
+            break;
+        case FileIndex::Change::Rename:
+            // Children keep their parent id, only the renamed row changes
+            if (!store.renamePath(QString::fromStdString(change.oldPath), path))
+                store.insertPath(path, change.type, change.priority);
+            break;
+        case FileIndex::Change::Stamp:
+            store.setStamp(path, change.stamp);
+            break;
+        }
+    }
+    if (!db.commit())
+        qWarning() << "IndexWriter commit failed:" << db.lastError().text();
+
+    double commitMs = timer.nsecsElapsed() / 1e6;
+    TraceLog::complete("writer commit", started, TraceLog::Clock::now());
+    static Histogram& commits = Metrics::histogram("writer.commit");
+    static Histogram& applies = Metrics::histogram("writer.apply");
+    static Counter& changes = Metrics::counter("writer.changes");
+    commits.record(commitMs);
+    changes.add(submitted);
+    {
+        ScopedTimer applyTimer(applies, "writer apply");
+        index.apply(group);
+    }
+
+    {
+        lock_guard<mutex> guard(statsLock);
+        ++totals.commits;
+        totals.changes += submitted;
+        totals.lastCommitMs = commitMs;
+        totals.maxCommitMs = max(totals.maxCommitMs, commitMs);
+        totals.totalCommitMs += commitMs;
+    }
+
+    if (commitMs > SlowCommitMs)
+        qDebug() << "IndexWriter: slow commit of" << submitted << "changes took" << commitMs << "ms";
+}
+
+void IndexWriter::checkpoint() {
+    if (snapshotPath.isEmpty()) return;
+
+    QElapsedTimer timer;
+    timer.start();
+    // Changes queue up meanwhile, searches keep running
+    if (!index.checkpoint(snapshotPath.toStdString())) {
+        qWarning() << "IndexWriter: writing the index snapshot failed:" << snapshotPath;
+        return;
+    }
+
+    lock_guard<mutex> guard(statsLock);
+    ++totals.checkpoints;
+    totals.lastCheckpointMs = timer.nsecsElapsed() / 1e6;
+}
@@ -0,0 +1,71 @@
+#ifndef INDEXWRITER_H
+#define INDEXWRITER_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "boundedqueue.h"
+#include "fileindex.h"
+
+class IndexStore;
+
+/*
+The one place watcher changes are written from.
+Changes are queued by any thread and applied by a single writer thread on
+its own connection, grouped into one transaction per CommitIntervalMs or
+MaxGroup changes, whichever comes first. After a group is committed it goes
+into the index under one write lock, so a search sees either all of it or
+none of it. Every CheckpointIntervalMs with changes the index is written out
+as a snapshot, so the next start maps a recent state instead of loading it.
+*/
+class IndexWriter {
+public:
+    static constexpr int CommitIntervalMs = 100;
+    static constexpr size_t MaxGroup = 4096;
+    static constexpr size_t QueueCapacity = 65536;
+    static constexpr double SlowCommitMs = 250; // commits slower than this are logged
+    static constexpr int64_t CheckpointIntervalMs = 10 * 60 * 1000;
+
+    struct Stats {
+        uint64_t commits = 0;
+        uint64_t changes = 0;
+        double lastCommitMs = 0;
+        double maxCommitMs = 0;
+        double totalCommitMs = 0;
+        uint64_t checkpoints = 0;
+        double lastCheckpointMs = 0;
+
+        double averageCommitMs() const { return commits ? totalCommitMs / commits : 0; }
+    };
+
+    // snapshotPath is the base name of the snapshot files, see FileIndex::checkpoint()
+    IndexWriter(FileIndex& index, const QString& databasePath, const QString& snapshotPath);
+    // Commits what is still queued before returning
+    ~IndexWriter();
+
+    void start();
+    // Blocks while the queue is full, false once the writer was stopped
+    bool submit(FileIndex::Change change);
+    void stop();
+
+    Stats stats() const;
+
+private:
+    void run();
+    void commitGroup(QSqlDatabase& db, IndexStore& store, std::vector<FileIndex::Change>& group);
+    void checkpoint();
+
+    FileIndex& index;
+    QString databasePath;
+    QString snapshotPath;
+    BoundedQueue<FileIndex::Change> queue{ QueueCapacity };
+    std::thread writer;
+
+    mutable std::mutex statsLock;
+    Stats totals;
+};
+
+#endif // INDEXWRITER_H
@@ -0,0 +1,162 @@
+#include "itembulkloader.h"
+#include "indexstore.h"
+
+#include <QSqlError>
+#include <QStringList>
+#include <QDebug>
+#include <QElapsedTimer>
+
+using namespace std;
+
+namespace {
+
+// Measures the time spent in one loader call
+class BusyTimer {
+public:
+    explicit BusyTimer(qint64& total) : total(total) { timer.start(); }
+    ~BusyTimer() { total += timer.nsecsElapsed(); }
+
+private:
+    qint64& total;
+    QElapsedTimer timer;
+};
+
+}
+
+ItemBulkLoader::ItemBulkLoader(QSqlDatabase& db)
+    : db(db), multiInsert(db), singleInsert(db), priorityUpdate(db), stampUpdate(db) {
+    pending.reserve(RowsPerInsert);
+}
+
+bool ItemBulkLoader::exec(const QString& sql) {
+    QSqlQuery query(db);
+    if (query.exec(sql)) return true;
+    qWarning() << "Bulk load:" << sql << query.lastError().text();
+    return false;
+}
+
+bool ItemBulkLoader::begin() {
+    BusyTimer busy(busyNs);
+
+    // page_size only applies to a new database, the others last for this connection
+    exec("PRAGMA page_size = 8192");
+    exec("PRAGMA journal_mode = WAL");
+    exec("PRAGMA synchronous = OFF");
+    exec("PRAGMA cache_size = -131072"); // 128 MiB
+    exec("PRAGMA temp_store = MEMORY");
+
+    exec("DROP TABLE IF EXISTS items_new");
+    if (!exec(IndexStore::createTableSql("items_new")))
+        return false;
+
+    QStringList rowsSql;
+    for (int i = 0; i < RowsPerInsert; ++i)
+        rowsSql << "(?, ?, ?, ?, ?, ?, ?)";
+    const QString insert = "INSERT INTO items_new (id, parent_id, name, type, priority, mtime, size) VALUES ";
+    multiInsert.prepare(insert + rowsSql.join(", "));
+    singleInsert.prepare(insert + "(?, ?, ?, ?, ?, ?, ?)");
+    priorityUpdate.prepare("UPDATE items_new SET priority = ? WHERE id = ?");
+    stampUpdate.prepare("UPDATE items_new SET mtime = ?, size = ? WHERE id = ?");
+
+    return db.transaction();
+}
+
+void ItemBulkLoader::add(qint64 id, qint64 parentId, const QString& name, char type, int priority,
+                         const DirStamp& stamp) {
+    pending.append({ id, parentId, name, type, priority, stamp });
+    if (pending.size() == RowsPerInsert)
+        flush();
+}
+
+void ItemBulkLoader::addFromIndex(const FileIndex& index, uint32_t firstId, uint32_t lastId,
+                                  const vector<DirStamp>* stamps) {
+    FileIndex::EntryInfo info;
+    for (uint32_t id = firstId; id < lastId; ++id) {
+        if (!index.entryInfo(id, info) || !info.alive) continue;
+        // Files keep their own time and size in the columns a folder keeps its stamp in
+        DirStamp stamp = (stamps && id < stamps->size()) ? (*stamps)[id] : DirStamp();
+        if (info.type != 'd')
+            stamp = { info.attributes.mtime, info.attributes.size };
+        add(rowIdOf(id), info.parent == FileIndex::NoParent ? 0 : rowIdOf(info.parent),
+            QString::fromStdString(info.name), info.type, info.priority, stamp);
+    }
+}
+
+void ItemBulkLoader::setPriority(qint64 id, int priority) {
+    flush();
+    BusyTimer busy(busyNs);
+    priorityUpdate.bindValue(0, priority);
+    priorityUpdate.bindValue(1, id);
+    if (!priorityUpdate.exec())
+        qWarning() << "Bulk load update failed:" << priorityUpdate.lastError().text();
+}
+
+void ItemBulkLoader::setStamp(qint64 id, const DirStamp& stamp) {
+    flush();
+    BusyTimer busy(busyNs);
+    stampUpdate.bindValue(0, stamp.mtime);
+    stampUpdate.bindValue(1, stamp.size);
+    stampUpdate.bindValue(2, id);
+    if (!stampUpdate.exec())
+        qWarning() << "Bulk load update failed:" << stampUpdate.lastError().text();
+}
+
+void ItemBulkLoader::flush() {
+    if (pending.isEmpty()) return;
+    BusyTimer busy(busyNs);
+
+    static const QString dirType = QStringLiteral("d");
+    static const QString fileType = QStringLiteral("f");
+
+    bool full = pending.size() == RowsPerInsert;
+    QSqlQuery& query = full ? multiInsert : singleInsert;
+    for (int i = 0; i < pending.size(); ++i) {
+        const Row& row = pending[i];
+        int base = full ? i * 7 : 0;
+        query.bindValue(base, row.id);
+        query.bindValue(base + 1, row.parentId);
+        query.bindValue(base + 2, row.name);
+        query.bindValue(base + 3, row.type == 'd' ? dirType : fileType);
+        query.bindValue(base + 4, row.priority);
+        query.bindValue(base + 5, row.stamp.mtime);
+        query.bindValue(base + 6, row.stamp.size);
+        if (!full && !query.exec())
+            qWarning() << "Bulk load insert failed:" << query.lastError().text();
+    }
+    if (full && !query.exec())
+        qWarning() << "Bulk load insert failed:" << query.lastError().text();
+
+    rows += pending.size();
+    pending.clear();
+}
+
+void ItemBulkLoader::commit() {
+    flush();
+    BusyTimer busy(busyNs);
+    db.commit();
+    db.transaction();
+}
+
+bool ItemBulkLoader::finish() {
+    flush();
+    BusyTimer busy(busyNs);
+    db.commit();
+
+    // One sorted index build instead of a b-tree update per row
+    db.transaction();
+    bool swapped = exec("DROP TABLE IF EXISTS items")
+                   && exec("ALTER TABLE items_new RENAME TO items")
+                   && exec(IndexStore::createIndexSql("items"));
+    if (!swapped) {
+        db.rollback();
+        return false;
+    }
+    db.commit();
+
+    exec("PRAGMA synchronous = NORMAL");
+    return true;
+}
+
+double ItemBulkLoader::rowsPerSecond() const {
+    return busyNs > 0 ? rows * 1e9 / busyNs : 0.0;
+}
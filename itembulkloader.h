@@ -0,0 +1,69 @@
+#ifndef ITEMBULKLOADER_H
+#define ITEMBULKLOADER_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+#include <vector>
+#include "fileindex.h"
+#include "fsbackend.h"
+
+/*
+Writes a full scan into the items table.
+Rows go into an unindexed staging table through one prepared multi-row
+INSERT, the unique (parent, name) index is built once at the end and the
+staging table then replaces items. The load runs with relaxed pragmas that are
+restored afterwards.
+*/
+class ItemBulkLoader {
+public:
+    explicit ItemBulkLoader(QSqlDatabase& db);
+
+    // Sets the load pragmas and creates the staging table, false when the database can't take it
+    bool begin();
+    void add(qint64 id, qint64 parentId, const QString& name, char type, int priority,
+             const DirStamp& stamp = DirStamp());
+    // Rows for index ids [firstId, lastId), a row id is the index id + 1. stamps is indexed by index id.
+    void addFromIndex(const FileIndex& index, uint32_t firstId, uint32_t lastId,
+                      const std::vector<DirStamp>* stamps = nullptr);
+    // For a row already added, when a later batch brings its own priority or stamp
+    void setPriority(qint64 id, int priority);
+    void setStamp(qint64 id, const DirStamp& stamp);
+    // Makes what was added so far durable, the staging table stays invisible until finish()
+    void commit();
+    // Indexes the staging table and swaps it in for items
+    bool finish();
+
+    static qint64 rowIdOf(uint32_t indexId) { return qint64(indexId) + 1; }
+
+    qint64 rowCount() const { return rows; }
+    // Rows per second of time spent inside the loader, scan time not included
+    double rowsPerSecond() const;
+
+private:
+    static const int RowsPerInsert = 128; // 7 values each, stays under SQLite's 999 variable limit
+
+    struct Row {
+        qint64 id;
+        qint64 parentId;
+        QString name;
+        char type;
+        int priority;
+        DirStamp stamp;
+    };
+
+    bool exec(const QString& sql);
+    void flush();
+
+    QSqlDatabase& db;
+    QSqlQuery multiInsert;
+    QSqlQuery singleInsert;
+    QSqlQuery priorityUpdate;
+    QSqlQuery stampUpdate;
+    QVector<Row> pending;
+    qint64 rows = 0;
+    qint64 busyNs = 0;
+};
+
+#endif // ITEMBULKLOADER_H
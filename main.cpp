@@ -1,12 +1,25 @@
 #include "mainwindow.h"
+#include "metrics.h"
 
 #include <QApplication>
 
+// VULTURE_METRICS and VULTURE_TRACE name files the metrics and the trace are written to on exit
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
     QCoreApplication::setApplicationName("Vulture");
-    MainWindow w;
-    w.show();
-    return a.exec();
+    QString metricsFile = qEnvironmentVariable("VULTURE_METRICS");
+    QString traceFile = qEnvironmentVariable("VULTURE_TRACE");
+    if (!traceFile.isEmpty()) TraceLog::enable();
+
+    int status;
+    {
+        MainWindow w;
+        w.show();
+        status = a.exec();
+    }
+
+    if (!metricsFile.isEmpty()) Metrics::dump(metricsFile.toStdString());
+    if (!traceFile.isEmpty()) TraceLog::write(traceFile.toStdString());
+    return status;
 }
@@ -1,7 +1,5 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
-#include "traverselib.h"
-#include "drivewatcher.h"
 #include <QtSql>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -28,6 +26,8 @@
 #include <QPushButton>
 #include <QTimer>
 #include <QDateTime>
+#include <QThreadPool>
+#include <algorithm>
 
 #define debugg(msg) qDebug() << msg
 using namespace std;
@@ -42,7 +42,7 @@ MainWindow::MainWindow(QWidget *parent)
     setAttribute(Qt::WA_TranslucentBackground);
     setFixedSize(500, 110);
 
-    db.setDatabaseName(QDir::currentPath() + "/files.db");
+    db.setDatabaseName(indexPaths.database);
     if (!db.open()) {
         qWarning() << "Failed to open database connection:" << db.lastError().text();
     }
@@ -136,21 +136,27 @@ MainWindow::MainWindow(QWidget *parent)
     iconLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
     iconLabel->show();
 
-    suggestionList = new QListWidget(this);
+    // Rows are painted from index ids on demand, no widget per result
+    resultModel = new ResultModel(fileIndex, this);
+    suggestionList = new QListView(this);
+    suggestionList->setModel(resultModel);
+    suggestionList->setItemDelegate(new ResultDelegate(suggestionList));
+    suggestionList->setUniformItemSizes(true);
+    suggestionList->setSelectionMode(QAbstractItemView::NoSelection);
     suggestionList->setWindowFlags(Qt::FramelessWindowHint | Qt::ToolTip);
     suggestionList->setFocusPolicy(Qt::NoFocus);
     suggestionList->setAttribute(Qt::WA_ShowWithoutActivating);
     suggestionList->setMouseTracking(true);
     suggestionList->setStyleSheet(R"(
-        QListWidget {
+        QListView {
             border: 1px solid #aaa;
             border-radius: 6px;
             background-color: white;
         }
-        QListWidget::item {
+        QListView::item {
             margin: 2px;
         }
-        QListWidget::item:hover {
+        QListView::item:hover {
             background-color: #f5f5f5;
         }
     )");
@@ -170,109 +176,78 @@ MainWindow::MainWindow(QWidget *parent)
 
 
     // Debounced search logic
-    searchWatcher = new QFutureWatcher<QStringList>(this);
     debounceTimer = new QTimer(this);
     debounceTimer->setSingleShot(true);
-    int debounceDelayMs = 2000;
-
-    auto searchFileConcurrent = [this](const QString &text) -> QStringList {
-        QStringList allPaths;
-
-        {
-            QString connectionName = QUuid::createUuid().toString();
-            QSqlDatabase threadDb = QSqlDatabase::addDatabase("QSQLITE", connectionName);
-            threadDb.setDatabaseName(QDir::currentPath() + "/files.db");
-
-            if (threadDb.open()) {
-                QSqlQuery query(threadDb);
-                if (query.exec("SELECT path FROM items ORDER BY priority DESC, path ASC;")) {
-                    while (query.next()) {
-                        allPaths.append(query.value(0).toString());
-                    }
-                } else {
-                    qWarning() << "DB query error in thread:" << query.lastError().text();
-                }
-
-                threadDb.close();
-            }
-
-            QSqlDatabase::removeDatabase(connectionName);
-        }
-        int totalThreads = QThread::idealThreadCount();
-        int threadsToUse = max(2, totalThreads - 2);
-        int chunkSize = allPaths.size() / threadsToUse + 1;
-
-        QList<QStringList> chunks;
-        for (int i = 0; i < allPaths.size(); i += chunkSize) {
-            chunks.append(allPaths.mid(i, chunkSize));
-        }
-
-        QAtomicInt foundCount = 0;
-        const int maxResults = 500; //shows 500 results
-
-        auto mapFunc = [text, &foundCount, maxResults](const QStringList &chunk) -> QStringList {
-            QStringList filtered;
-            for (const QString &pah : chunk) {
-                if (foundCount.loadRelaxed() >= maxResults) break;
-                QString fname = QFileInfo(pah).fileName();
-                if (fname.contains(text, Qt::CaseInsensitive)) {
-                    int prev = foundCount.fetchAndAddRelaxed(1);
-                    if (prev < maxResults) {
-                        filtered.append(pah);
-                    } else {
-                        break;
-                    }
-                }
-            }
-            reverse(filtered.begin(),filtered.end());
-            return filtered;
-        };
-
+    int debounceDelayMs = 50; // refinements only recheck the previous matches
+    const int maxResults = 100000; // only the rows on screen cost anything
 
-        auto reduceFunc = [](QStringList &result, const QStringList &partial) {
-            result.append(partial);
-            if (result.size() > 50) {
-                result = result.mid(0, 50);
-            }
-        };
+    // Searches run here so the destructor can wait for the ones still unwinding
+    searchPool = new QThreadPool(this);
+    searchPool->setMaxThreadCount(2);
 
-        QStringList results = QtConcurrent::mappedReduced(chunks, mapFunc, reduceFunc, QtConcurrent::UnorderedReduce).result();
+    auto placeSuggestions = [=]() {
+        suggestionList->setFixedWidth(inputField->width());
+        int visibleCount = qMin(resultModel->rowCount(), 6);
+        int height = visibleCount * ResultDelegate::RowHeight + 8;
+        QPoint inputPos = inputField->mapToGlobal(QPoint(0, 0));
+        suggestionList->setFixedHeight(height);
+        suggestionList->move(inputPos.x(), inputPos.y() - height - 8);
+        suggestionList->show();
+        inputField->setFocus();
+    };
 
-        sort(results.begin(), results.end(), [](const QString &a, const QString &b) {
-            auto getPriority = [](const QString &path) -> int {
-                QFileInfo fi(path);
-                if (fi.isDir()) return 2;  // Folders
-                QString ext = fi.suffix().toLower();
+    // Early batches are appended as they arrive, the final ranked list replaces them
+    auto showResults = [=](const vector<uint32_t> &ids, bool finished) {
+        if (!finished) {
+            if (replaceResults)
+                resultModel->clear();
+            replaceResults = false;
+            resultModel->appendResults(ids, maxResults);
+            placeSuggestions();
+            return;
+        }
 
-                // High priority file types
-                QStringList popular = { "exe", "jpg", "jpeg", "png", "pdf", "docx", "txt", "xlsx", "pptx", "mp4", "mp3" };
-                if (ext == "lnk") return 3; // Shortcuts
-                if (popular.contains(ext)) return 0; // Popular files
-                return 1; // Other files
-            };
+        replaceResults = false;
+        resultModel->setResults(ids);
+        placeSuggestions();
+        statusLabel->clear();
+        updateLastScanLabel();
+    };
 
-            return getPriority(a) < getPriority(b); // lower number = higher priority
+    auto runSearch = [=](quint64 generation, const QString &text) {
+        bool completed = searchEngine.run(generation, text.toStdString(), maxResults,
+                                          [=](const vector<uint32_t> &ids, bool finished) {
+            // The final list arrives ranked by the index, see Ranking::key.
+            // Batches of a query the user already typed past are dropped here
+            QMetaObject::invokeMethod(this, [=]() {
+                if (searchEngine.isCurrent(generation))
+                    showResults(ids, finished);
+            }, Qt::QueuedConnection);
         });
 
-        return results;
+        // "regex:" queries that do not compile come back empty, say why
+        if (completed && !searchEngine.lastError().empty()) {
+            QMetaObject::invokeMethod(this, [=]() {
+                if (searchEngine.isCurrent(generation))
+                    statusLabel->setText("<b style='color:red;'>Invalid query</b>");
+            }, Qt::QueuedConnection);
+        }
     };
 
     // the search will only start once user has finished giving inputs
     connect(inputField, &QLineEdit::textChanged, this, [=](const QString &text) {
         statusLabel->setText("<b style='color:black;'>Searching...</b>");
-        lastResults.clear();
+        replaceResults = true;
+        // The running query stops at its next check, nothing waits for it
+        searchEngine.cancel();
         //At least the input length should be 3
         if (text.trimmed().length() < 3) {
             debounceTimer->stop();
             suggestionList->hide();
+            resultModel->clear();
             updateLastScanLabel();
             return;
         }
-        if (searchWatcher->isRunning()) {
-
-            searchWatcher->cancel();
-            searchWatcher->waitForFinished();
-        }
         debounceTimer->start(debounceDelayMs);
     });
 
@@ -283,58 +258,15 @@ MainWindow::MainWindow(QWidget *parent)
             suggestionList->hide();
             return;
         }
-        if (searchWatcher->isRunning()) {
-            searchWatcher->cancel();
-            searchWatcher->waitForFinished();
-        }
-        if (!text.isEmpty()) {
-            QFuture<QStringList> future = QtConcurrent::run(searchFileConcurrent, text);
-            searchWatcher->setFuture(future);
-        }
-
-    });
-
-    connect(searchWatcher, &QFutureWatcher<QStringList>::finished, this, [=]() {
-        QStringList matches = searchWatcher->result();
-        lastResults = matches;
-        suggestionList->clear();
-        if (matches.isEmpty()) {
-            QListWidgetItem *item = new QListWidgetItem(suggestionList);
-            item->setSizeHint(QSize(inputField->width(), 50));
-            QWidget *noResultWidget = new QWidget;
-            QHBoxLayout *layout = new QHBoxLayout(noResultWidget);
-            layout->setContentsMargins(10, 5, 10, 5);
-            QLabel *label = new QLabel("No results found.");
-            label->setStyleSheet("font-size:16px; color:gray; font-style:italic;");
-            layout->addWidget(label, 0, Qt::AlignLeft | Qt::AlignVCenter);
-            suggestionList->addItem(item);
-            suggestionList->setItemWidget(item, noResultWidget);
-        } else {
-            for (const QString &pah : matches) {
-                QString path = pah;
-                path = path.replace("\\\\", "\\");
-                QListWidgetItem *item = new QListWidgetItem(suggestionList);
-                item->setSizeHint(QSize(inputField->width(), 60));
-                item->setData(Qt::UserRole, path);
-                suggestionList->addItem(item);
-                suggestionList->setItemWidget(item, new ResultItemWidget(path));
-            }
-        }
-        suggestionList->setFixedWidth(inputField->width());
-        int visibleCount = qMin(matches.size(), 6);
-        int height = (matches.isEmpty() ? 50 : visibleCount * 60) + 8;
-        QPoint inputPos = inputField->mapToGlobal(QPoint(0, 0));
-        suggestionList->setFixedHeight(height);
-        suggestionList->move(inputPos.x(), inputPos.y() - height - 8);
-        suggestionList->show();
-        inputField->setFocus();
-        statusLabel->clear();
-        updateLastScanLabel();
-
+        replaceResults = true;
+        quint64 generation = searchEngine.start();
+        searchPool->start([=]() {
+            runSearch(generation, text);
+        });
     });
 
-    connect(suggestionList, &QListWidget::itemClicked, this, [=](QListWidgetItem *item) {
-       // QString path = item->data(Qt::UserRole).toString();
+    connect(suggestionList, &QListView::clicked, this, [=](const QModelIndex &index) {
+       // QString path = index.data(ResultModel::PathRole).toString();
        // if (!path.isEmpty()) {
             // inputField->setText(path);
        // }
@@ -343,10 +275,10 @@ MainWindow::MainWindow(QWidget *parent)
 
     // Context Menu
     suggestionList->setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(suggestionList, &QListWidget::customContextMenuRequested, this, [=](const QPoint &pos) {
-        QListWidgetItem *item = suggestionList->itemAt(pos);
-        if (!item) return;
-        QString path = item->data(Qt::UserRole).toString();
+    connect(suggestionList, &QListView::customContextMenuRequested, this, [=](const QPoint &pos) {
+        QModelIndex index = suggestionList->indexAt(pos);
+        if (!index.isValid()) return;
+        QString path = index.data(ResultModel::PathRole).toString();
         if (path.isEmpty()) return;
 
         QMenu menu;
@@ -369,8 +301,8 @@ MainWindow::MainWindow(QWidget *parent)
     });
 
     // Double click on entry(folders,files)
-    connect(suggestionList, &QListWidget::itemDoubleClicked, this, [=](QListWidgetItem *item) {
-        QString path = item->data(Qt::UserRole).toString();
+    connect(suggestionList, &QListView::doubleClicked, this, [=](const QModelIndex &index) {
+        QString path = index.data(ResultModel::PathRole).toString();
         if (!path.isEmpty()) {
             QDesktopServices::openUrl(QUrl::fromLocalFile(path));
         }
@@ -403,6 +335,15 @@ MainWindow::MainWindow(QWidget *parent)
         suggestionList->hide();
     });
 
+    // Ctrl+F switches to abbreviation matching ("vltrcfg" finds vulture_config.json) and back
+    QShortcut *fuzzyShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_F), this);
+    connect(fuzzyShortcut, &QShortcut::activated, this, [=]() {
+        searchEngine.setFuzzy(!searchEngine.isFuzzy());
+        inputField->setPlaceholderText(searchEngine.isFuzzy() ? "Fuzzy search..." : "Search...");
+        if (inputField->text().trimmed().length() >= 3)
+            debounceTimer->start(0);
+    });
+
     QScreen *screen = QGuiApplication::primaryScreen();
     if (screen) {
         QRect screenGeometry = screen->availableGeometry();
@@ -414,27 +355,32 @@ MainWindow::MainWindow(QWidget *parent)
     });
 
     // Initial Status
+    // Scanned folders are searchable as soon as they reach the index, typing stays enabled
     statusLabel->setText("<b style='color:black;'>Scanning...</b>");
-    inputField->setReadOnly(true);
     auto traverseWatcher = new QFutureWatcher<void>(this);
-    auto traverseFuture = QtConcurrent::run([=]() {
-        traverseAll();  // Runs in background
+    openFuture = QtConcurrent::run([=]() {
+        indexer.open();  // Runs in background
     });
-    traverseWatcher->setFuture(traverseFuture);
+    traverseWatcher->setFuture(openFuture);
 
-    // Update label after scan finishes
+    // Update label after scan finishes, the watcher only writes once the load has committed
     connect(traverseWatcher, &QFutureWatcher<void>::finished, this, [=]() {
         updateLastScanLabel();
-        inputField->setReadOnly(false);
+        driveWatcher.startWriting();
     });
 
     // Monitors all drives for changes
-    DriveWatch();
+    driveWatcher.start();
 }
 
 MainWindow::~MainWindow()
 {
     debugg("here destroyed!");
+    // The open still running would write to members that are about to go
+    indexer.stop();
+    openFuture.waitForFinished();
+    searchEngine.cancel();
+    searchPool->waitForDone();
     if (db.isOpen()) {
         db.close();
         QSqlDatabase::removeDatabase("db_connection");
@@ -450,7 +396,7 @@ bool MainWindow::event(QEvent *event)
         }
          this->setWindowOpacity(0.7);
     } else if (event->type() == QEvent::WindowActivate) {
-        if (!lastResults.isEmpty() && !suggestionList->isVisible()) {
+        if (resultModel->hasResults() && !suggestionList->isVisible()) {
             suggestionList->show();
         }
          this->setWindowOpacity(1.0);
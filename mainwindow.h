@@ -3,10 +3,11 @@
 #pragma once
 #include <QLineEdit>
 #include <QMainWindow>
-#include <QListWidget>
+#include <QListView>
 #include <QFocusEvent>
 #include <QSqlDatabase>
 #include <QFutureWatcher>
+#include <QThreadPool>
 #include <QWidget>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
@@ -15,6 +16,12 @@
 #include <QIcon>
 #include <QPixmap>
 #include <QFileIconProvider>
+#include <QDir>
+#include "drivewatcher.h"
+#include "fileindex.h"
+#include "indexer.h"
+#include "resultlist.h"
+#include "searchengine.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -32,56 +39,27 @@ public:
     bool event(QEvent *event);
     bool eventFilter(QObject *obj, QEvent *event);
     QLineEdit *inputField;
-    QListWidget *suggestionList;
+    QListView *suggestionList;
 
 
 private:
     Ui::MainWindow *ui;
     QSqlDatabase db;
     QLabel *statusLabel;
-    QStringList lastResults;
-    QFutureWatcher<QStringList> *searchWatcher;
+    ResultModel *resultModel;
+    bool replaceResults = true; // the next streamed batch starts a new list
     QTimer *debounceTimer;
+    IndexPaths indexPaths = IndexPaths::in(QDir::currentPath());
+    FileIndex fileIndex;
+    SearchEngine searchEngine{fileIndex};
+    DriveWatcher driveWatcher{fileIndex, indexPaths.database, indexPaths.snapshot};
+    Indexer indexer{fileIndex, indexPaths};
+    QFuture<void> openFuture; // the destructor stops it and waits, it writes to fileIndex
+    QThreadPool *searchPool;
     long long int time = 0;
 
 };
 
 
 
-class ResultItemWidget : public QWidget {
-public:
-    ResultItemWidget(const QString &path, QWidget *parent = nullptr) : QWidget(parent) {
-        setFixedHeight(48); // Uniform height
-
-        static QFileIconProvider provider;
-        QFileInfo fileInfo(path);
-        QIcon icon = provider.icon(fileInfo);
-
-        auto *layout = new QHBoxLayout(this);
-        layout->setContentsMargins(10, 6, 10, 6);
-        layout->setSpacing(10); // Exact 10px gap
-
-        QLabel *iconLabel = new QLabel;
-        QPixmap pixmap = icon.pixmap(32, 32);
-        iconLabel->setPixmap(pixmap);
-        iconLabel->setFixedSize(32, 32);
-        iconLabel->setAlignment(Qt::AlignLeft | Qt::AlignVCenter);
-        layout->addWidget(iconLabel);
-        auto *textLayout = new QVBoxLayout;
-        textLayout->setContentsMargins(0, 0, 0, 0);
-        textLayout->setSpacing(2);
-
-        QLabel *nameLabel = new QLabel(fileInfo.fileName());
-        nameLabel->setStyleSheet("font-weight: 600; font-size: 14px;");
-        QLabel *pathLabel = new QLabel(path);
-        pathLabel->setStyleSheet("color: #777; font-size: 11px;");
-
-        textLayout->addWidget(nameLabel);
-        textLayout->addWidget(pathLabel);
-        layout->addLayout(textLayout);
-    }
-};
-
-
-
 #endif // MAINWINDOW_H
@@ -0,0 +1,81 @@
+#include "mappedfile.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32) || defined(_WIN64)
+
+shared_ptr<MappedFile> MappedFile::open(const string& path) {
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, path.data(), int(path.size()), nullptr, 0);
+    wstring widePath(wideLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.data(), int(path.size()), &widePath[0], wideLength);
+
+    // Delete sharing lets a newer snapshot replace this one while it is still mapped
+    HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->base = static_cast<const char*>(view);
+    mapped->length = size_t(size.QuadPart);
+    mapped->mapping = mapping;
+    return mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+}
+
+#else
+
+shared_ptr<MappedFile> MappedFile::open(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    // The mapping keeps the file alive on its own, even after a rename replaces it
+    void* view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return nullptr;
+
+    shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->base = static_cast<const char*>(view);
+    mapped->length = size_t(st.st_size);
+    return mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (base) munmap(const_cast<char*>(base), length);
+}
+
+#endif
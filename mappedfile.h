@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// A whole file mapped read-only, unmapped once the last reference is gone
+class MappedFile {
+public:
+    // Null when the file can't be opened or is empty
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    MappedFile() = default;
+
+    const char* base = nullptr;
+    size_t length = 0;
+#if defined(_WIN32) || defined(_WIN64)
+    void* mapping = nullptr; // HANDLE of the file mapping, the file handle is closed right after mapping
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,254 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = TraceLog::Clock;
+
+struct Registry {
+    mutex lock;
+    map<string, unique_ptr<Counter>> counters;
+    map<string, unique_ptr<Gauge>> gauges;
+    map<string, unique_ptr<Histogram>> histograms;
+    Clock::time_point started = Clock::now();
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+template <typename T>
+T& findOrAdd(map<string, unique_ptr<T>>& metrics, const string& name) {
+    lock_guard<mutex> guard(registry().lock);
+    unique_ptr<T>& metric = metrics[name];
+    if (!metric) metric = make_unique<T>();
+    return *metric;
+}
+
+void raiseTo(atomic<uint64_t>& target, uint64_t value) {
+    uint64_t seen = target.load(memory_order_relaxed);
+    while (seen < value && !target.compare_exchange_weak(seen, value, memory_order_relaxed)) {}
+}
+
+// Metric and trace names are plain ASCII, but a path may end up in one
+void appendQuoted(string& out, const string& text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+string number(double value) {
+    ostringstream out;
+    out.precision(6);
+    out << (isfinite(value) ? value : 0.0);
+    return out.str();
+}
+
+bool writeFile(const string& path, const string& contents) {
+    string tempPath = path + ".tmp";
+    {
+        ofstream file(fs::u8path(tempPath), ios::binary | ios::trunc);
+        if (!file) return false;
+        file << contents;
+        if (!file.flush()) return false;
+    }
+    error_code ec;
+    fs::rename(fs::u8path(tempPath), fs::u8path(path), ec);
+    if (ec) fs::remove(fs::u8path(tempPath), ec);
+    return !ec;
+}
+
+struct TraceEvent {
+    const char* name;
+    int64_t startUs;
+    int64_t durationUs;
+    uint32_t thread;
+};
+
+struct TraceBuffer {
+    mutex lock;
+    vector<TraceEvent> events;
+    size_t capacity = 0;
+    uint64_t dropped = 0;
+    Clock::time_point origin = Clock::now();
+};
+
+TraceBuffer& traceBuffer() {
+    static TraceBuffer instance;
+    return instance;
+}
+
+// Small thread numbers read better in the trace viewer than hashed ids
+uint32_t traceThreadId() {
+    static atomic<uint32_t> next{ 1 };
+    thread_local uint32_t id = next.fetch_add(1);
+    return id;
+}
+
+}
+
+void Gauge::raise(int64_t level) {
+    int64_t seen = highest.load(memory_order_relaxed);
+    while (seen < level && !highest.compare_exchange_weak(seen, level, memory_order_relaxed)) {}
+}
+
+void Histogram::record(double ms) {
+    uint64_t us = ms > 0 ? uint64_t(ms * 1000) : 0;
+    size_t bucket = 0;
+    while (bucket + 1 < Buckets && (uint64_t(1) << bucket) <= us)
+        ++bucket;
+
+    buckets[bucket].fetch_add(1, memory_order_relaxed);
+    samples.fetch_add(1, memory_order_relaxed);
+    totalUs.fetch_add(us, memory_order_relaxed);
+    raiseTo(maxUs, us);
+}
+
+double Histogram::percentile(double p) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+
+    uint64_t rank = max<uint64_t>(1, uint64_t(ceil(p * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Buckets; ++i) {
+        seen += buckets[i].load(memory_order_relaxed);
+        if (seen >= rank) return min((uint64_t(1) << i) / 1000.0, maxMs());
+    }
+    return maxMs();
+}
+
+Counter& Metrics::counter(const string& name) {
+    return findOrAdd(registry().counters, name);
+}
+
+Gauge& Metrics::gauge(const string& name) {
+    return findOrAdd(registry().gauges, name);
+}
+
+Histogram& Metrics::histogram(const string& name) {
+    return findOrAdd(registry().histograms, name);
+}
+
+string Metrics::toJson() {
+    Registry& metrics = registry();
+    lock_guard<mutex> guard(metrics.lock);
+    double uptime = chrono::duration<double>(Clock::now() - metrics.started).count();
+
+    string out = "{\n  \"uptime_s\": " + number(uptime) + ",\n  \"counters\": {";
+    const char* comma = "";
+    for (const auto& [name, counter] : metrics.counters) {
+        out += comma;
+        out += "\n    ";
+        appendQuoted(out, name);
+        uint64_t value = counter->load();
+        out += ": { \"value\": " + to_string(value) + ", \"per_second\": " + number(uptime > 0 ? value / uptime : 0) + " }";
+        comma = ",";
+    }
+
+    out += "\n  },\n  \"gauges\": {";
+    comma = "";
+    for (const auto& [name, gauge] : metrics.gauges) {
+        out += comma;
+        out += "\n    ";
+        appendQuoted(out, name);
+        out += ": { \"value\": " + to_string(gauge->load()) + ", \"peak\": " + to_string(gauge->peak()) + " }";
+        comma = ",";
+    }
+
+    out += "\n  },\n  \"histograms\": {";
+    comma = "";
+    for (const auto& [name, histogram] : metrics.histograms) {
+        out += comma;
+        out += "\n    ";
+        appendQuoted(out, name);
+        uint64_t count = histogram->count();
+        out += ": { \"count\": " + to_string(count)
+               + ", \"total_ms\": " + number(histogram->totalMs())
+               + ", \"mean_ms\": " + number(count ? histogram->totalMs() / count : 0)
+               + ", \"p50_ms\": " + number(histogram->percentile(0.50))
+               + ", \"p90_ms\": " + number(histogram->percentile(0.90))
+               + ", \"p99_ms\": " + number(histogram->percentile(0.99))
+               + ", \"max_ms\": " + number(histogram->maxMs()) + " }";
+        comma = ",";
+    }
+    out += "\n  }\n}\n";
+    return out;
+}
+
+bool Metrics::dump(const string& path) {
+    return writeFile(path, toJson());
+}
+
+void TraceLog::enable(size_t maxEvents) {
+    TraceBuffer& buffer = traceBuffer();
+    {
+        lock_guard<mutex> guard(buffer.lock);
+        buffer.capacity = maxEvents;
+        buffer.events.reserve(min<size_t>(maxEvents, 65536));
+    }
+    on = true;
+}
+
+void TraceLog::complete(const char* name, Clock::time_point start, Clock::time_point end) {
+    if (!enabled()) return;
+    TraceBuffer& buffer = traceBuffer();
+    uint32_t thread = traceThreadId();
+
+    lock_guard<mutex> guard(buffer.lock);
+    if (buffer.events.size() >= buffer.capacity) {
+        ++buffer.dropped;
+        return;
+    }
+    auto us = [&](Clock::duration d) { return chrono::duration_cast<chrono::microseconds>(d).count(); };
+    buffer.events.push_back({ name, us(start - buffer.origin), us(end - start), thread });
+}
+
+bool TraceLog::write(const string& path) {
+    TraceBuffer& buffer = traceBuffer();
+    string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    {
+        lock_guard<mutex> guard(buffer.lock);
+        const char* comma = "\n";
+        for (const TraceEvent& event : buffer.events) {
+            out += comma;
+            out += "{\"name\":";
+            appendQuoted(out, event.name);
+            out += ",\"ph\":\"X\",\"pid\":1,\"tid\":" + to_string(event.thread) + ",\"ts\":" + to_string(event.startUs)
+                   + ",\"dur\":" + to_string(event.durationUs) + "}";
+            comma = ",\n";
+        }
+        out += "\n],\"otherData\":{\"dropped_events\":" + to_string(buffer.dropped) + "}}\n";
+    }
+    return writeFile(path, out);
+}
+
+ScopedTimer::~ScopedTimer() {
+    TraceLog::Clock::time_point end = TraceLog::Clock::now();
+    histogram.record(chrono::duration<double, milli>(end - start).count());
+    if (traceName) TraceLog::complete(traceName, start, end);
+}
@@ -0,0 +1,108 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+Process wide counters, gauges and latency histograms for the hot paths.
+A call site looks its metric up once and keeps the reference, recording is
+then a relaxed atomic add and never takes a lock. Metrics::toJson() dumps
+all of them, TraceLog adds Chrome trace events when it was switched on.
+*/
+class Counter {
+public:
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t load() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{ 0 };
+};
+
+// A level like a queue depth, remembers the highest value it was set to
+class Gauge {
+public:
+    void set(int64_t level) {
+        value.store(level, std::memory_order_relaxed);
+        raise(level);
+    }
+    void add(int64_t delta) { raise(value.fetch_add(delta, std::memory_order_relaxed) + delta); }
+    int64_t load() const { return value.load(std::memory_order_relaxed); }
+    int64_t peak() const { return highest.load(std::memory_order_relaxed); }
+
+private:
+    void raise(int64_t level);
+
+    std::atomic<int64_t> value{ 0 };
+    std::atomic<int64_t> highest{ 0 };
+};
+
+// Power-of-two microsecond buckets, a percentile is the upper bound of its bucket
+class Histogram {
+public:
+    static constexpr size_t Buckets = 32; // the last one takes everything above 35 minutes
+
+    void record(double ms);
+
+    uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+    double totalMs() const { return totalUs.load(std::memory_order_relaxed) / 1000.0; }
+    double maxMs() const { return maxUs.load(std::memory_order_relaxed) / 1000.0; }
+    double percentile(double p) const;
+
+private:
+    std::atomic<uint64_t> buckets[Buckets] = {};
+    std::atomic<uint64_t> samples{ 0 };
+    std::atomic<uint64_t> totalUs{ 0 };
+    std::atomic<uint64_t> maxUs{ 0 };
+};
+
+class Metrics {
+public:
+    // Created on first use, the reference stays valid for the whole run
+    static Counter& counter(const std::string& name);
+    static Gauge& gauge(const std::string& name);
+    static Histogram& histogram(const std::string& name);
+
+    // Every metric in one JSON object, counter rates are per second since the first metric was used
+    static std::string toJson();
+    // Replaces path with toJson() in one rename, so a reader never sees half a dump
+    static bool dump(const std::string& path);
+};
+
+// Chrome trace events (chrome://tracing, Perfetto), off unless enable() was called
+class TraceLog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Keeps at most maxEvents, later ones are counted and dropped
+    static void enable(size_t maxEvents = 1000000);
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+    // A span on the calling thread, name must outlive the log (a string literal)
+    static void complete(const char* name, Clock::time_point start, Clock::time_point end);
+    static bool write(const std::string& path);
+
+private:
+    static inline std::atomic<bool> on{ false };
+};
+
+// Times a scope into a histogram, and into the trace when traceName is given
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram, const char* traceName = nullptr)
+        : histogram(histogram), traceName(traceName), start(TraceLog::Clock::now()) {}
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram;
+    const char* traceName;
+    TraceLog::Clock::time_point start;
+};
+
+#endif // METRICS_H
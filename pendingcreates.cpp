@@ -0,0 +1,99 @@
+#include "pendingcreates.h"
+
+using namespace std;
+
+PendingCreates::PendingCreates(char separator, Clock::duration delay) : separator(separator), delay(delay) {}
+
+vector<pair<string, PendingCreates::Pending>> PendingCreates::extract(const string& path) {
+    vector<pair<string, Pending>> taken;
+    auto exact = byPath.find(path);
+    if (exact != byPath.end()) {
+        taken.emplace_back(exact->first, exact->second);
+        byPath.erase(exact);
+    }
+
+    // Children sort right after the prefix, but not always right after path itself ("a-b" < "a/b")
+    string prefix = path;
+    if (prefix.empty() || prefix.back() != separator)
+        prefix += separator;
+    auto it = byPath.lower_bound(prefix);
+    while (it != byPath.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        taken.emplace_back(it->first, it->second);
+        it = byPath.erase(it);
+    }
+    return taken;
+}
+
+void PendingCreates::schedule(const string& path, char type, Clock::time_point deadline) {
+    uint64_t sequence = nextSequence++;
+    byPath[path] = { type, deadline, sequence };
+    deadlines.push({ deadline, sequence, path });
+}
+
+bool PendingCreates::isCurrent(const Slot& slot) const {
+    auto it = byPath.find(slot.path);
+    return it != byPath.end() && it->second.sequence == slot.sequence;
+}
+
+// Rebuilds the heap once stale slots outnumber live ones, so churn can't grow it without bound
+void PendingCreates::dropStale() {
+    if (deadlines.size() <= 2 * byPath.size() + 1024) return;
+
+    vector<Slot> live;
+    live.reserve(byPath.size());
+    while (!deadlines.empty()) {
+        if (isCurrent(deadlines.top())) live.push_back(deadlines.top());
+        deadlines.pop();
+    }
+    for (Slot& slot : live)
+        deadlines.push(move(slot));
+}
+
+void PendingCreates::add(const string& path, char type, Clock::time_point now) {
+    // A second create of the same path restarts its delay
+    schedule(path, type, now + delay);
+    dropStale();
+}
+
+void PendingCreates::remove(const string& path) {
+    extract(path);
+    dropStale();
+}
+
+bool PendingCreates::rename(const string& oldPath, const string& newPath) {
+    vector<pair<string, Pending>> moved = extract(oldPath);
+
+    // Renaming over a pending create replaces it
+    extract(newPath);
+
+    bool wasPending = false;
+    for (const auto& entry : moved) {
+        string path = newPath + entry.first.substr(oldPath.size());
+        wasPending = wasPending || entry.first.size() == oldPath.size();
+        schedule(path, entry.second.type, entry.second.deadline);
+    }
+    dropStale();
+    return wasPending;
+}
+
+vector<PendingCreates::Ready> PendingCreates::takeDue(Clock::time_point now) {
+    vector<Ready> due;
+    while (!deadlines.empty() && deadlines.top().deadline <= now) {
+        Slot slot = deadlines.top();
+        deadlines.pop();
+
+        auto it = byPath.find(slot.path);
+        if (it == byPath.end() || it->second.sequence != slot.sequence) continue;
+        due.push_back({ move(slot.path), it->second.type });
+        byPath.erase(it);
+    }
+    return due;
+}
+
+bool PendingCreates::nextDeadline(Clock::time_point& when) {
+    while (!deadlines.empty() && !isCurrent(deadlines.top()))
+        deadlines.pop();
+    if (deadlines.empty()) return false;
+    when = deadlines.top().deadline;
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef PENDINGCREATES_H
+#define PENDINGCREATES_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+Created entries waiting out a delay before they are written, so a new folder
+that is renamed or deleted right away never lands under its first name.
+Entries are kept by path for removes and renames, deadlines sit in a min-heap.
+A removed or renamed entry leaves its old heap slot behind, the sequence
+number tells the stale slots apart when they come up.
+Not thread safe, callers hold their own lock.
+*/
+class PendingCreates {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Ready {
+        std::string path;
+        char type;
+    };
+
+    PendingCreates(char separator, Clock::duration delay);
+
+    void add(const std::string& path, char type, Clock::time_point now = Clock::now());
+    // Drops path and everything pending below it
+    void remove(const std::string& path);
+    // Moves what is pending at or below oldPath, true when oldPath itself was pending
+    bool rename(const std::string& oldPath, const std::string& newPath);
+
+    // Creates whose delay is over, oldest first
+    std::vector<Ready> takeDue(Clock::time_point now = Clock::now());
+    // When the oldest create is due, false when nothing is pending
+    bool nextDeadline(Clock::time_point& when);
+
+    size_t size() const { return byPath.size(); }
+    bool empty() const { return byPath.empty(); }
+
+private:
+    struct Pending {
+        char type;
+        Clock::time_point deadline;
+        uint64_t sequence;
+    };
+
+    struct Slot {
+        Clock::time_point deadline;
+        uint64_t sequence;
+        std::string path;
+
+        bool operator>(const Slot& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    // Takes path and everything pending below it out of byPath
+    std::vector<std::pair<std::string, Pending>> extract(const std::string& path);
+    void schedule(const std::string& path, char type, Clock::time_point deadline);
+    bool isCurrent(const Slot& slot) const;
+    void dropStale();
+
+    char separator;
+    Clock::duration delay;
+    std::map<std::string, Pending> byPath; // ordered, so a folder's pending children are one range
+    std::priority_queue<Slot, std::vector<Slot>, std::greater<Slot>> deadlines;
+    uint64_t nextSequence = 0;
+};
+
+#endif // PENDINGCREATES_H
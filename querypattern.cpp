@@ -0,0 +1,164 @@
+#include "querypattern.h"
+#include "fileindex.h"
+
+using namespace std;
+
+namespace {
+
+string folded(string_view text) {
+    string out(text);
+    FileIndex::foldCase(out);
+    return out;
+}
+
+// Index just past the ']' closing the class that starts at begin
+size_t skipClass(string_view e, size_t begin) {
+    size_t i = begin + 1;
+    if (i < e.size() && e[i] == '^') ++i;
+    if (i < e.size() && e[i] == ']') ++i;
+    while (i < e.size() && e[i] != ']')
+        i += e[i] == '\\' ? 2 : 1;
+    return min(i + 1, e.size());
+}
+
+// Index just past the ')' closing the group that starts at begin
+size_t skipGroup(string_view e, size_t begin) {
+    int depth = 0;
+    size_t i = begin;
+    while (i < e.size()) {
+        char c = e[i];
+        if (c == '\\') {
+            i += 2;
+            continue;
+        }
+        if (c == '[') {
+            i = skipClass(e, i);
+            continue;
+        }
+        if (c == '(') ++depth;
+        if (c == ')' && --depth == 0) return i + 1;
+        ++i;
+    }
+    return e.size();
+}
+
+}
+
+QueryPattern::QueryPattern(const string& query) {
+    if (string_view(query).substr(0, RegexPrefix.size()) == RegexPrefix) {
+        patternKind = Regex;
+        text = query.substr(RegexPrefix.size());
+        try {
+            compiled = regex(text, regex::ECMAScript | regex::icase | regex::optimize);
+        } catch (const regex_error& e) {
+            valid = false;
+            message = e.what();
+        }
+        required = regexLiteral(text);
+        return;
+    }
+
+    text = folded(query);
+    if (text.find_first_of("*?") == string::npos) {
+        required = text;
+        return;
+    }
+
+    // Every fragment between wildcards is in a match, the longest one narrows best
+    patternKind = Glob;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = min(text.find_first_of("*?", begin), text.size());
+        if (end - begin > required.size()) required = text.substr(begin, end - begin);
+        begin = end + 1;
+    }
+}
+
+bool QueryPattern::matches(string_view name) const {
+    switch (patternKind) {
+    case Substring:
+        return folded(name).find(text) != string::npos;
+    case Glob:
+        return globMatches(name);
+    case Regex:
+        return valid && regex_search(name.begin(), name.end(), compiled);
+    }
+    return false;
+}
+
+bool QueryPattern::globMatches(string_view original) const {
+    string name = folded(original);
+
+    // Greedy with one backtrack point, the last * seen takes one more character on a mismatch
+    size_t p = 0, n = 0;
+    size_t star = string::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < text.size() && (text[p] == '?' || text[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < text.size() && text[p] == '*') {
+            star = p++;
+            resume = n;
+        } else if (star != string::npos) {
+            p = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < text.size() && text[p] == '*')
+        ++p;
+    return p == text.size();
+}
+
+string QueryPattern::regexLiteral(string_view e) {
+    string best, run;
+    auto endRun = [&]() {
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+
+    size_t i = 0;
+    while (i < e.size()) {
+        char c = e[i];
+        bool literal = false;
+        size_t next = i + 1;
+
+        if (c == '\\') {
+            // \. is a dot, \d \w \b and friends are not one fixed character
+            if (i + 1 >= e.size()) return string();
+            c = e[i + 1];
+            next = i + 2;
+            literal = string_view(".^$|?*+()[]{}\\/-").find(c) != string_view::npos;
+        } else if (c == '[') {
+            next = skipClass(e, i);
+        } else if (c == '(') {
+            next = skipGroup(e, i);
+        } else if (c == '|' || c == ')') {
+            // Either side of an alternation may match, nothing is required
+            return string();
+        } else {
+            literal = string_view(".^$?*+{").find(c) == string_view::npos;
+        }
+
+        // An optional atom is not required, one that repeats ends the run after it
+        char quantifier = next < e.size() ? e[next] : '\0';
+        bool optional = quantifier == '?' || quantifier == '*' || quantifier == '{';
+        if (literal && !optional) run += c;
+        if (!literal || optional || quantifier == '+') endRun();
+
+        bool quantified = true;
+        if (quantifier == '{') {
+            size_t close = e.find('}', next);
+            next = close == string_view::npos ? e.size() : close + 1;
+        } else if (quantifier == '?' || quantifier == '*' || quantifier == '+') {
+            ++next;
+        } else {
+            quantified = false;
+        }
+        if (quantified && next < e.size() && e[next] == '?') ++next; // lazy
+        i = next;
+    }
+    endRun();
+    return folded(best);
+}
@@ -0,0 +1,48 @@
+#ifndef QUERYPATTERN_H
+#define QUERYPATTERN_H
+
+#include <regex>
+#include <string>
+#include <string_view>
+
+/*
+What the search box text means. Plain text is a substring, text with * or ?
+is a glob over the whole name ("*.pdf", "report_20??_*.xlsx") and text that
+starts with "regex:" is an ECMAScript regular expression searched in the name.
+Substrings and globs ignore case the way FileIndex::foldCase does, a regex
+ignores ASCII case. literal() is a fragment every matching name
+must contain, the index finds those names first and only they are matched.
+*/
+class QueryPattern {
+public:
+    enum Kind { Substring, Glob, Regex };
+
+    static constexpr std::string_view RegexPrefix = "regex:";
+
+    explicit QueryPattern(const std::string& text);
+
+    Kind kind() const { return patternKind; }
+    // False for a regex that does not compile, error() says why
+    bool isValid() const { return valid; }
+    const std::string& error() const { return message; }
+
+    // Lower-cased, empty when no fragment is required and every name has to be matched
+    const std::string& literal() const { return required; }
+
+    bool matches(std::string_view name) const;
+
+    // The longest run of characters every match of the regex contains, empty when unsure
+    static std::string regexLiteral(std::string_view expression);
+
+private:
+    bool globMatches(std::string_view name) const;
+
+    Kind patternKind = Substring;
+    std::string text;      // the glob lower-cased, the regex as typed
+    std::string required;
+    std::regex compiled;
+    bool valid = true;
+    std::string message;
+};
+
+#endif // QUERYPATTERN_H
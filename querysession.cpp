@@ -0,0 +1,87 @@
+#include "querysession.h"
+#include "metrics.h"
+#include "querypattern.h"
+
+#include <ctime>
+
+using namespace std;
+
+QuerySession::QuerySession(const FileIndex& index)
+    : index(index) {
+}
+
+vector<uint32_t> QuerySession::search(const string& text, size_t maxResults,
+                                     const FileIndex::SearchControl* control) {
+    filter = FileIndex::FilterStats();
+    error.clear();
+
+    AttributeFilter attributes;
+    string rest;
+    if (!AttributeFilter::parse(text, uint32_t(time(nullptr)), attributes, rest, error)) {
+        reset();
+        return {};
+    }
+
+    // Wildcards, regular expressions and filters are spelled out, they win over fuzzy mode
+    QueryPattern pattern(rest);
+    if (pattern.kind() != QueryPattern::Substring || !attributes.empty()) {
+        // The pattern's matches are no base for narrowing the next query
+        reset();
+        if (!pattern.isValid()) {
+            error = pattern.error();
+            return {};
+        }
+        if (fuzzy && pattern.kind() == QueryPattern::Substring && !rest.empty()) {
+            refined = false;
+            return index.fuzzySearch(rest, maxResults, attributes, control);
+        }
+        // A substring is settled by the literal alone
+        function<bool(string_view)> accept;
+        if (pattern.kind() != QueryPattern::Substring)
+            accept = [&](string_view name) { return pattern.matches(name); };
+        FileIndex::MatchSet found = index.matchWhere(pattern.literal(), accept, attributes, control, &filter);
+        return index.topResults(found.ids, maxResults);
+    }
+
+    static Histogram& fuzzyTimes = Metrics::histogram("query.fuzzy");
+    if (fuzzy) {
+        ScopedTimer timer(fuzzyTimes, "query fuzzy");
+        refined = false;
+        return index.fuzzySearch(text, maxResults, AttributeFilter(), control);
+    }
+
+    string query = text;
+    FileIndex::foldCase(query);
+
+    // Every name containing the new text also contains the old one
+    refined = hasMatches && !lastQuery.empty() && query.find(lastQuery) != string::npos;
+
+    static Histogram& narrowTimes = Metrics::histogram("query.narrow");
+    static Histogram& matchTimes = Metrics::histogram("query.match");
+    static Histogram& rankTimes = Metrics::histogram("query.rank");
+    if (refined) {
+        ScopedTimer timer(narrowTimes, "query narrow");
+        matches = index.narrow(matches, query, control);
+    } else {
+        ScopedTimer timer(matchTimes, "query match");
+        matches = index.matchAll(query, control);
+    }
+
+    lastQuery = query;
+    hasMatches = matches.complete;
+    ScopedTimer timer(rankTimes, "query rank");
+    return index.topResults(matches.ids, maxResults);
+}
+
+void QuerySession::reset() {
+    lastQuery.clear();
+    matches = FileIndex::MatchSet();
+    hasMatches = false;
+    refined = false;
+}
+
+void QuerySession::setFuzzy(bool enabled) {
+    if (fuzzy == enabled) return;
+    fuzzy = enabled;
+    reset();
+}
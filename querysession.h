@@ -0,0 +1,47 @@
+#ifndef QUERYSESSION_H
+#define QUERYSESSION_H
+
+#include <string>
+#include <vector>
+#include "fileindex.h"
+
+/*
+Remembers the full match set of the last query while the user keeps typing.
+When the new text still contains the previous one ("repo" -> "repor") only the
+previous matches are checked again, anything else starts from the whole index.
+Globs and regular expressions (see QueryPattern) always start from the
+whole index, narrowed by the literal they require, and so do queries with
+ext:, size: and other attribute filters (see AttributeFilter).
+Not thread safe, one session belongs to one search box.
+*/
+class QuerySession {
+public:
+    explicit QuerySession(const FileIndex& index);
+
+    // A cancelled query is not kept as the base for the next one
+    std::vector<uint32_t> search(const std::string& text, size_t maxResults,
+                                 const FileIndex::SearchControl* control = nullptr);
+    void reset();
+    // Fuzzy queries are scored from scratch every time, they do not narrow
+    void setFuzzy(bool enabled);
+    bool isFuzzy() const { return fuzzy; }
+
+    bool lastWasRefinement() const { return refined; }
+    size_t candidateCount() const { return matches.ids.size(); }
+    // Stages of the last glob, regex or filtered query, zero for the others
+    const FileIndex::FilterStats& lastFilter() const { return filter; }
+    // Empty unless the last query had a regex that does not compile or a filter that can't be read
+    const std::string& lastError() const { return error; }
+
+private:
+    const FileIndex& index;
+    std::string lastQuery; // case-folded
+    FileIndex::MatchSet matches;
+    bool hasMatches = false;
+    bool refined = false;
+    bool fuzzy = false;
+    FileIndex::FilterStats filter;
+    std::string error;
+};
+
+#endif // QUERYSESSION_H
@@ -0,0 +1,35 @@
+#include "ranking.h"
+
+using namespace std;
+
+namespace {
+
+const string_view PopularExtensions[] = {
+    "exe", "jpg", "jpeg", "png", "pdf", "docx", "txt", "xlsx", "pptx", "mp4", "mp3"
+};
+
+bool sameFolded(string_view a, string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char c = a[i];
+        if (c >= 'A' && c <= 'Z') c = char(c + ('a' - 'A'));
+        if (c != b[i]) return false;
+    }
+    return true;
+}
+
+}
+
+Ranking::Kind Ranking::kindOf(string_view name, bool isDir) {
+    if (isDir) return Folder;
+
+    size_t dot = name.rfind('.');
+    if (dot == string_view::npos) return OtherFile;
+    string_view extension = name.substr(dot + 1);
+
+    if (sameFolded(extension, "lnk")) return Shortcut;
+    for (string_view popular : PopularExtensions) {
+        if (sameFolded(extension, popular)) return PopularFile;
+    }
+    return OtherFile;
+}
@@ -0,0 +1,106 @@
+#ifndef RANKING_H
+#define RANKING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/*
+Everything a result is ranked by is known when the entry is added: whether
+it sits in a user folder, what kind of entry it is, how long its name is
+and how deep it lies. The kind and the depth share one byte per entry, the
+rest is already in the entry, so ranking never looks at the disk.
+*/
+namespace Ranking {
+
+// Best first, the order the result list has always used
+enum Kind : uint8_t {
+    PopularFile = 0, // documents, pictures, media and programs
+    OtherFile = 1,
+    Folder = 2,
+    Shortcut = 3     // .lnk
+};
+
+const unsigned int MaxDepth = 63;
+
+Kind kindOf(std::string_view name, bool isDir);
+
+inline uint8_t pack(Kind kind, unsigned int depth) {
+    return uint8_t((unsigned(kind) << 6) | std::min(depth, MaxDepth));
+}
+inline unsigned int depthOf(uint8_t packed) { return packed & MaxDepth; }
+inline Kind kindOf(uint8_t packed) { return Kind(packed >> 6); }
+
+// Lower is better: user files, then kind, shorter names, shallower paths, and the id breaks ties
+inline uint64_t key(bool userFile, uint8_t packed, size_t nameLength, uint32_t id) {
+    return (uint64_t(userFile ? 0 : 1) << 63) | (uint64_t(kindOf(packed)) << 61)
+           | (uint64_t(std::min<size_t>(nameLength, 0x7fff)) << 46) | (uint64_t(depthOf(packed)) << 40) | id;
+}
+inline uint32_t idOf(uint64_t key) { return uint32_t(key); }
+
+// Fuzzy matches: the higher score wins, then the same order as key() without the depth
+inline uint64_t fuzzyKey(int score, bool userFile, uint8_t packed, size_t nameLength, uint32_t id) {
+    uint64_t penalty = uint64_t(std::clamp(0x8000 - score, 0, 0xffff));
+    return (penalty << 48) | (uint64_t(userFile ? 0 : 1) << 47) | (uint64_t(kindOf(packed)) << 45)
+           | (uint64_t(std::min<size_t>(nameLength, 0x1fff)) << 32) | id;
+}
+
+}
+
+/*
+The k smallest keys pushed so far. Keys are only collected until k of them
+are in, after that a max-heap keeps the best k, so an unbounded TopK costs
+no more than a vector. Every search thread fills its own and they are merged
+at the end, the result does not depend on which thread finished first.
+*/
+class TopK {
+public:
+    explicit TopK(size_t k) : maxKeys(k) {}
+
+    void push(uint64_t key) {
+        if (keys.size() < maxKeys) {
+            keys.push_back(key);
+            if (keys.size() == maxKeys) std::make_heap(keys.begin(), keys.end());
+        } else if (maxKeys > 0 && key < keys.front()) {
+            std::pop_heap(keys.begin(), keys.end());
+            keys.back() = key;
+            std::push_heap(keys.begin(), keys.end());
+        }
+    }
+
+    void merge(const TopK& other) {
+        for (uint64_t key : other.keys)
+            push(key);
+    }
+
+    size_t size() const { return keys.size(); }
+    size_t limit() const { return maxKeys; }
+
+    // Ids, best first
+    std::vector<uint32_t> ids() const {
+        std::vector<uint64_t> sorted = keys;
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<uint32_t> out;
+        out.reserve(sorted.size());
+        for (uint64_t key : sorted)
+            out.push_back(Ranking::idOf(key));
+        return out;
+    }
+
+    // Ids in no particular order, for callers that sort them their own way
+    std::vector<uint32_t> unrankedIds() const {
+        std::vector<uint32_t> out;
+        out.reserve(keys.size());
+        for (uint64_t key : keys)
+            out.push_back(Ranking::idOf(key));
+        return out;
+    }
+
+private:
+    size_t maxKeys;
+    std::vector<uint64_t> keys;
+};
+
+#endif // RANKING_H
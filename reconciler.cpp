@@ -0,0 +1,113 @@
+#include "reconciler.h"
+#include "workstealing.h"
+
+#include <iterator>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+// Listing names are looked up the way the index compares them
+inline string lookupKey(string_view name) {
+    string key(name);
+#if defined(_WIN32) || defined(_WIN64)
+    FileIndex::foldCase(key);
+#endif
+    return key;
+}
+
+}
+
+Reconciler::Reconciler(const FileIndex& index, const FsBackend& backend, PriorityFunc priorityOf)
+    : index(index), backend(backend), priorityOf(move(priorityOf)) {}
+
+Reconciler::Changes Reconciler::run(unsigned int numThreads, const vector<string>& roots) const {
+    vector<uint32_t> offsets;
+    vector<uint32_t> children;
+    index.childLists(offsets, children);
+
+    WorkStealingScheduler<Task> scheduler(numThreads);
+    vector<Changes> found(scheduler.workerCount());
+
+    for (const string& root : roots.empty() ? backend.roots() : roots)
+        scheduler.seed({ nullptr, root, 0, index.find(root) });
+
+    scheduler.run([&](unsigned int worker, Task& task) {
+        Changes& out = found[worker];
+        if (stopFlag && *stopFlag) return;
+
+        FsBackend::DirectoryRef dir = backend.open(task.parent, task.path.substr(task.nameStart), task.path);
+        if (!dir) return; // gone or unreadable, a vanished folder shows up in its parent's listing
+
+        DirStamp now;
+        backend.stamp(dir, now);
+        ++out.checked;
+
+        auto pushChild = [&](string_view name, uint32_t id) {
+            string childPath = backend.join(task.path, name);
+            size_t nameStart = childPath.size() - name.size();
+            scheduler.push(worker, { dir, move(childPath), nameStart, id });
+        };
+
+        bool known = task.id != FileIndex::NoParent;
+        DirStamp before = known ? index.stampOf(task.id) : DirStamp();
+        bool sameStamp = before.known() && before == now;
+        bool untouched = known && changedSince != 0 && now.known() && now.mtime < changedSince;
+        if (sameStamp || untouched) {
+            // Same entries as last time, only the folders below need a look
+            for (uint32_t i = offsets[task.id]; i < offsets[task.id + 1]; ++i) {
+                uint32_t child = children[i];
+                if (index.typeOf(child) == 'd')
+                    pushChild(index.nameOf(child), child);
+            }
+            return;
+        }
+
+        ++out.listed;
+        unordered_map<string, uint32_t> stored;
+        if (known) {
+            for (uint32_t i = offsets[task.id]; i < offsets[task.id + 1]; ++i)
+                stored.emplace(lookupKey(index.nameOf(children[i])), children[i]);
+        }
+
+        backend.list(dir, [&](string_view name, bool isDir, const FileAttributes& attributes) {
+            if (name.find('$') != string_view::npos) return;
+
+            auto it = stored.find(lookupKey(name));
+            if (it != stored.end()) {
+                uint32_t id = it->second;
+                stored.erase(it);
+                if ((index.typeOf(id) == 'd') == isDir) {
+                    if (isDir) {
+                        pushChild(name, id);
+                    } else if (index.attributesDiffer(id, attributes)) {
+                        // Adding a known file updates its size and time
+                        string path = backend.join(task.path, name);
+                        out.added.push_back({ path, 'f', priorityOf(path), attributes });
+                    }
+                    return;
+                }
+                out.removed.push_back(id); // a file became a folder or the other way round
+            }
+
+            string path = backend.join(task.path, name);
+            out.added.push_back({ path, isDir ? 'd' : 'f', priorityOf(path), attributes });
+            if (isDir) pushChild(name, FileIndex::NoParent);
+        });
+
+        for (const auto& item : stored)
+            out.removed.push_back(item.second);
+        out.stamps.emplace_back(task.path, now);
+    });
+
+    Changes all;
+    for (Changes& part : found) {
+        all.added.insert(all.added.end(), make_move_iterator(part.added.begin()), make_move_iterator(part.added.end()));
+        all.removed.insert(all.removed.end(), part.removed.begin(), part.removed.end());
+        all.stamps.insert(all.stamps.end(), make_move_iterator(part.stamps.begin()), make_move_iterator(part.stamps.end()));
+        all.checked += part.checked;
+        all.listed += part.listed;
+    }
+    return all;
+}
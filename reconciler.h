@@ -0,0 +1,67 @@
+#ifndef RECONCILER_H
+#define RECONCILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "fileindex.h"
+#include "fsbackend.h"
+
+/*
+Brings a loaded index up to date without a full rescan.
+Every known folder is opened and stamped, but only folders whose stamp
+differs from the stored one are listed and diffed against the index.
+A folder's stamp only covers its own entries, so unchanged folders are still
+descended into, they just cost one stat instead of a listing.
+Folders that did not exist before are listed in full.
+*/
+class Reconciler {
+public:
+    struct Added {
+        std::string path;
+        char type;
+        int priority;
+        FileAttributes attributes;
+    };
+
+    struct Changes {
+        std::vector<Added> added; // also known files of a listed folder whose size or time changed
+        std::vector<uint32_t> removed; // index ids, a folder takes its subtree with it
+        std::vector<std::pair<std::string, DirStamp>> stamps; // folders that were listed
+        size_t checked = 0; // folders stamped
+        size_t listed = 0;  // folders that had to be listed
+    };
+
+    using PriorityFunc = std::function<int(const std::string& path)>;
+
+    // Stored stamps come from FileIndex::stampOf(), an unknown stamp means the folder gets listed
+    Reconciler(const FileIndex& index, const FsBackend& backend, PriorityFunc priorityOf);
+
+    // Folders whose modification time is older than mtime count as unchanged without a stored stamp,
+    // used to resync a subtree after the watcher lost events
+    void setChangedSince(int64_t mtime) { changedSince = mtime; }
+    // Once stop is set the walk lists nothing more and run() returns what it has, which is incomplete
+    void setStopFlag(const std::atomic<bool>* stop) { stopFlag = stop; }
+
+    // Walks roots, or every backend root when it is empty
+    Changes run(unsigned int numThreads, const std::vector<std::string>& roots = {}) const;
+
+private:
+    struct Task {
+        FsBackend::DirectoryRef parent;
+        std::string path;
+        size_t nameStart = 0;
+        uint32_t id = FileIndex::NoParent; // NoParent for a folder the index does not know
+    };
+
+    const FileIndex& index;
+    const FsBackend& backend;
+    PriorityFunc priorityOf;
+    int64_t changedSince = 0;
+    const std::atomic<bool>* stopFlag = nullptr;
+};
+
+#endif // RECONCILER_H
@@ -0,0 +1,168 @@
+#include "resultlist.h"
+
+#include <QApplication>
+#include <QFileInfo>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QStyle>
+#include <algorithm>
+
+using namespace std;
+
+ResultModel::ResultModel(const FileIndex& index, QObject* parent)
+    : QAbstractListModel(parent), index(index) {
+}
+
+int ResultModel::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid()) return 0;
+    return placeholder ? 1 : int(ids.size());
+}
+
+QVariant ResultModel::data(const QModelIndex& modelIndex, int role) const {
+    if (!modelIndex.isValid() || modelIndex.row() >= rowCount()) return QVariant();
+
+    if (placeholder) {
+        if (role == Qt::DisplayRole) return QStringLiteral("No results found.");
+        if (role == PlaceholderRole) return true;
+        return QVariant();
+    }
+
+    int row = modelIndex.row();
+    switch (role) {
+    case Qt::DisplayRole:
+        return QString::fromStdString(index.nameOf(ids[size_t(row)]));
+    case Qt::ToolTipRole:
+    case PathRole:
+        return pathAt(row);
+    case Qt::DecorationRole:
+        return iconOf(row);
+    case PlaceholderRole:
+        return false;
+    }
+    return QVariant();
+}
+
+void ResultModel::setResults(const vector<uint32_t>& results) {
+    if (!results.empty() && results == ids) return;
+
+    beginResetModel();
+    ids = results;
+    paths.assign(ids.size(), QString());
+    placeholder = ids.empty();
+    endResetModel();
+}
+
+void ResultModel::appendResults(const vector<uint32_t>& results, size_t limit) {
+    if (placeholder) clear();
+    size_t count = min(results.size(), limit > ids.size() ? limit - ids.size() : 0);
+    if (count == 0) return;
+
+    beginInsertRows(QModelIndex(), int(ids.size()), int(ids.size() + count - 1));
+    ids.insert(ids.end(), results.begin(), results.begin() + ptrdiff_t(count));
+    paths.resize(ids.size());
+    endInsertRows();
+}
+
+void ResultModel::clear() {
+    beginResetModel();
+    ids.clear();
+    paths.clear();
+    placeholder = false;
+    endResetModel();
+}
+
+QString ResultModel::pathAt(int row) const {
+    if (row < 0 || size_t(row) >= ids.size()) return QString();
+
+    QString& path = paths[size_t(row)];
+    if (path.isEmpty()) {
+        path = QString::fromStdString(index.pathOf(ids[size_t(row)]));
+        path.replace("\\\\", "\\");
+    }
+    return path;
+}
+
+/*
+QFileIconProvider reads a file to find its icon. One icon per suffix is
+close enough for a result list and keeps that to one read per suffix.
+Programs and shortcuts carry an icon of their own, they get the plain file
+icon rather than one read per row.
+*/
+QIcon ResultModel::iconOf(int row) const {
+    uint32_t id = ids[size_t(row)];
+    if (index.typeOf(id) == 'd') {
+        auto it = icons.find(QStringLiteral("/"));
+        if (it == icons.end()) it = icons.insert(QStringLiteral("/"), iconProvider.icon(QFileIconProvider::Folder));
+        return *it;
+    }
+
+    QString name = QString::fromStdString(index.nameOf(id));
+    int dot = name.lastIndexOf('.');
+    QString suffix = dot > 0 ? name.mid(dot + 1).toLower() : QString();
+    auto it = icons.find(suffix);
+    if (it != icons.end()) return *it;
+
+    bool ownIcon = suffix == "exe" || suffix == "lnk" || suffix == "ico" || suffix == "url";
+    QString path = ownIcon ? QString() : pathAt(row);
+    if (path.isEmpty()) return iconProvider.icon(QFileIconProvider::File);
+    return *icons.insert(suffix, iconProvider.icon(QFileInfo(path)));
+}
+
+void ResultDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+    const QWidget* widget = opt.widget;
+    QStyle* style = widget ? widget->style() : QApplication::style();
+
+    // Only the background comes from the style, so the list's hover and selection colors apply
+    opt.text.clear();
+    opt.icon = QIcon();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter, widget);
+
+    painter->save();
+    QRect area = option.rect.adjusted(10, 6, -10, -6);
+
+    if (index.data(ResultModel::PlaceholderRole).toBool()) {
+        QFont font = option.font;
+        font.setPixelSize(16);
+        font.setItalic(true);
+        painter->setFont(font);
+        painter->setPen(Qt::gray);
+        painter->drawText(area, Qt::AlignLeft | Qt::AlignVCenter, index.data(Qt::DisplayRole).toString());
+        painter->restore();
+        return;
+    }
+
+    QIcon icon = qvariant_cast<QIcon>(index.data(Qt::DecorationRole));
+    icon.paint(painter, QRect(area.left(), area.top() + (area.height() - 32) / 2, 32, 32));
+    area.setLeft(area.left() + 32 + 10);
+
+    QFont nameFont = option.font;
+    nameFont.setPixelSize(14);
+    nameFont.setWeight(QFont::DemiBold);
+    QFont pathFont = option.font;
+    pathFont.setPixelSize(11);
+    QFontMetrics nameMetrics(nameFont);
+    QFontMetrics pathMetrics(pathFont);
+
+    // Name over path with a 2px gap, centered as a block
+    int top = area.top() + (area.height() - nameMetrics.height() - 2 - pathMetrics.height()) / 2;
+    QRect nameRect(area.left(), top, area.width(), nameMetrics.height());
+    QRect pathRect(area.left(), nameRect.bottom() + 1 + 2, area.width(), pathMetrics.height());
+
+    painter->setFont(nameFont);
+    painter->setPen(opt.palette.color(QPalette::Text));
+    painter->drawText(nameRect, Qt::AlignLeft | Qt::AlignVCenter,
+                      nameMetrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideRight, area.width()));
+
+    painter->setFont(pathFont);
+    painter->setPen(QColor("#777"));
+    painter->drawText(pathRect, Qt::AlignLeft | Qt::AlignVCenter,
+                      pathMetrics.elidedText(index.data(ResultModel::PathRole).toString(), Qt::ElideMiddle,
+                                             area.width()));
+    painter->restore();
+}
+
+QSize ResultDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex&) const {
+    return QSize(option.rect.width(), RowHeight);
+}
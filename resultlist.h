@@ -0,0 +1,63 @@
+#ifndef RESULTLIST_H
+#define RESULTLIST_H
+
+#include <QAbstractListModel>
+#include <QFileIconProvider>
+#include <QHash>
+#include <QIcon>
+#include <QStyledItemDelegate>
+#include <vector>
+#include "fileindex.h"
+
+/*
+Search results as index ids. A row's name, path and icon are only looked up
+when the view asks for them, which it does for the rows on screen, so the
+list holds a hundred thousand results for the cost of their ids.
+An empty result shows a single "No results found." row.
+*/
+class ResultModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    enum Role {
+        PathRole = Qt::UserRole, // empty for an entry removed since the search
+        PlaceholderRole          // true for the "No results found." row
+    };
+
+    explicit ResultModel(const FileIndex& index, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    // Replaces every row, the same ids as before leave the view alone
+    void setResults(const std::vector<uint32_t>& results);
+    // Streamed matches go after the current rows, up to limit rows in total
+    void appendResults(const std::vector<uint32_t>& results, size_t limit);
+    void clear();
+
+    bool hasResults() const { return !ids.empty(); }
+    QString pathAt(int row) const;
+
+private:
+    QIcon iconOf(int row) const;
+
+    const FileIndex& index;
+    std::vector<uint32_t> ids;
+    mutable std::vector<QString> paths; // filled the first time a row is shown
+    bool placeholder = false;
+    mutable QHash<QString, QIcon> icons; // by lower-cased suffix, "/" for folders
+    QFileIconProvider iconProvider;
+};
+
+// Paints a row straight from the model: icon, name and the path below it
+class ResultDelegate : public QStyledItemDelegate {
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    static const int RowHeight = 60;
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+};
+
+#endif // RESULTLIST_H
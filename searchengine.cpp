@@ -0,0 +1,75 @@
+#include "searchengine.h"
+#include "metrics.h"
+
+using namespace std;
+
+SearchEngine::SearchEngine(const FileIndex& index)
+    : session(index) {
+}
+
+uint64_t SearchEngine::start() {
+    return ++generation;
+}
+
+void SearchEngine::cancel() {
+    ++generation;
+}
+
+bool SearchEngine::isCurrent(uint64_t value) const {
+    return generation.load(memory_order_relaxed) == value;
+}
+
+bool SearchEngine::run(uint64_t value, const string& text, size_t maxResults,
+                       const BatchCallback& onBatch, size_t batchSize) {
+    static Histogram& waits = Metrics::histogram("query.session_wait");
+    static Histogram& firstBatches = Metrics::histogram("query.first_batch");
+    static Histogram& totals = Metrics::histogram("query.total");
+    static Counter& abandoned = Metrics::counter("query.abandoned");
+    auto msSince = [](TraceLog::Clock::time_point start) {
+        return chrono::duration<double, milli>(TraceLog::Clock::now() - start).count();
+    };
+
+    // An abandoned query still holds the session until its next check, which is quick
+    TraceLog::Clock::time_point start = TraceLog::Clock::now();
+    lock_guard<mutex> guard(sessionLock);
+    waits.record(msSince(start));
+    if (!isCurrent(value)) {
+        abandoned.add();
+        return false;
+    }
+
+    size_t delivered = 0;
+    FileIndex::SearchControl control;
+    control.batchSize = batchSize;
+    control.cancelled = [this, value]() { return !isCurrent(value); };
+    control.partial = [&](const vector<uint32_t>& ids) {
+        // Early batches only need to fill the first screen
+        if (delivered >= maxResults) return;
+        if (delivered == 0) firstBatches.record(msSince(start));
+        vector<uint32_t> batch(ids.begin(), ids.begin() + min(ids.size(), maxResults - delivered));
+        delivered += batch.size();
+        onBatch(batch, false);
+    };
+
+    session.setFuzzy(fuzzy);
+    vector<uint32_t> results = session.search(text, maxResults, &control);
+    if (!isCurrent(value)) {
+        abandoned.add();
+        return false;
+    }
+
+    totals.record(msSince(start));
+    TraceLog::complete("query", start, TraceLog::Clock::now());
+    onBatch(results, true);
+    return true;
+}
+
+FileIndex::FilterStats SearchEngine::lastFilter() {
+    lock_guard<mutex> guard(sessionLock);
+    return session.lastFilter();
+}
+
+string SearchEngine::lastError() {
+    lock_guard<mutex> guard(sessionLock);
+    return session.lastError();
+}
@@ -0,0 +1,47 @@
+#ifndef SEARCHENGINE_H
+#define SEARCHENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "querysession.h"
+
+/*
+Runs queries against the index with a generation number per query.
+Starting a new query makes every older one stop at its next check, so a
+keystroke never waits for a stale scan. Matches are handed out in batches
+while the query runs and the ranked top results follow at the end.
+*/
+class SearchEngine {
+public:
+    // finished is false for early, unranked batches and true for the final top results
+    using BatchCallback = std::function<void(const std::vector<uint32_t>& ids, bool finished)>;
+
+    explicit SearchEngine(const FileIndex& index);
+
+    // Opens a new generation, older queries are abandoned
+    uint64_t start();
+    void cancel();
+    bool isCurrent(uint64_t generation) const;
+    // Applies from the next run(), see FuzzyMatch
+    void setFuzzy(bool enabled) { fuzzy = enabled; }
+    bool isFuzzy() const { return fuzzy; }
+    // Of the last query that ran to the end, see QuerySession
+    FileIndex::FilterStats lastFilter();
+    std::string lastError();
+
+    // Runs in the calling thread. Returns false when a newer query replaced this one.
+    bool run(uint64_t generation, const std::string& text, size_t maxResults,
+             const BatchCallback& onBatch, size_t batchSize = 16);
+
+private:
+    std::atomic<uint64_t> generation{0};
+    std::atomic<bool> fuzzy{false};
+    std::mutex sessionLock;
+    QuerySession session;
+};
+
+#endif // SEARCHENGINE_H
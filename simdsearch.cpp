@@ -0,0 +1,168 @@
+#include "simdsearch.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMDSEARCH_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace SimdSearch {
+
+namespace {
+
+inline unsigned int lowestBit(unsigned int mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// First and last byte already matched, compare what is in between
+inline bool middleMatches(const char* at, const char* needle, size_t length) {
+    return length <= 2 || memcmp(at + 1, needle + 1, length - 2) == 0;
+}
+
+}
+
+const char* findScalar(const char* begin, const char* end, const char* needle, size_t length) {
+    if (length == 0) return begin;
+    if (size_t(end - begin) < length) return nullptr;
+
+    const char* last = end - length;
+    const char* p = begin;
+    while (p <= last) {
+        p = static_cast<const char*>(memchr(p, needle[0], size_t(last - p) + 1));
+        if (!p) return nullptr;
+        if (memcmp(p + 1, needle + 1, length - 1) == 0) return p;
+        ++p;
+    }
+    return nullptr;
+}
+
+#ifdef SIMDSEARCH_X86
+
+TARGET_SSE2
+const char* findSse2(const char* begin, const char* end, const char* needle, size_t length) {
+    if (length == 0) return begin;
+    if (size_t(end - begin) < length) return nullptr;
+
+    const char* last = end - length;
+    const __m128i firstByte = _mm_set1_epi8(needle[0]);
+    const __m128i lastByte = _mm_set1_epi8(needle[length - 1]);
+
+    const char* p = begin;
+    for (; last - p >= 15; p += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + length - 1));
+        __m128i both = _mm_and_si128(_mm_cmpeq_epi8(firstByte, blockFirst), _mm_cmpeq_epi8(lastByte, blockLast));
+
+        unsigned int mask = unsigned(_mm_movemask_epi8(both));
+        while (mask) {
+            unsigned int bit = lowestBit(mask);
+            if (middleMatches(p + bit, needle, length)) return p + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(p, end, needle, length);
+}
+
+TARGET_AVX2
+const char* findAvx2(const char* begin, const char* end, const char* needle, size_t length) {
+    if (length == 0) return begin;
+    if (size_t(end - begin) < length) return nullptr;
+
+    const char* last = end - length;
+    const __m256i firstByte = _mm256_set1_epi8(needle[0]);
+    const __m256i lastByte = _mm256_set1_epi8(needle[length - 1]);
+
+    const char* p = begin;
+    for (; last - p >= 31; p += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + length - 1));
+        __m256i both = _mm256_and_si256(_mm256_cmpeq_epi8(firstByte, blockFirst), _mm256_cmpeq_epi8(lastByte, blockLast));
+
+        unsigned int mask = unsigned(_mm256_movemask_epi8(both));
+        while (mask) {
+            unsigned int bit = lowestBit(mask);
+            if (middleMatches(p + bit, needle, length)) return p + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findSse2(p, end, needle, length);
+}
+
+bool hasSse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool hasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // The OS has to save the YMM registers too
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+const char* findSse2(const char* begin, const char* end, const char* needle, size_t length) {
+    return findScalar(begin, end, needle, length);
+}
+
+const char* findAvx2(const char* begin, const char* end, const char* needle, size_t length) {
+    return findScalar(begin, end, needle, length);
+}
+
+bool hasSse2() { return false; }
+bool hasAvx2() { return false; }
+
+#endif
+
+FindFunc bestKernel() {
+    static const FindFunc kernel = hasAvx2() ? findAvx2 : hasSse2() ? findSse2 : findScalar;
+    return kernel;
+}
+
+const char* kernelName() {
+    FindFunc kernel = bestKernel();
+    if (kernel == findAvx2) return "avx2";
+    if (kernel == findSse2) return "sse2";
+    return "scalar";
+}
+
+}
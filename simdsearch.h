@@ -0,0 +1,34 @@
+#ifndef SIMDSEARCH_H
+#define SIMDSEARCH_H
+
+#include <cstddef>
+#include <string_view>
+
+/*
+Substring kernels for already case-folded buffers.
+The vector versions compare the first and the last needle byte at 16 (SSE2) or
+32 (AVX2) candidate positions per instruction and only run memcmp on the hits.
+*/
+namespace SimdSearch {
+
+    using FindFunc = const char* (*)(const char* begin, const char* end, const char* needle, size_t length);
+
+    // First occurrence of needle in [begin, end) or nullptr
+    const char* findScalar(const char* begin, const char* end, const char* needle, size_t length);
+    const char* findSse2(const char* begin, const char* end, const char* needle, size_t length);
+    const char* findAvx2(const char* begin, const char* end, const char* needle, size_t length);
+
+    bool hasSse2();
+    bool hasAvx2();
+
+    // Widest kernel this CPU supports, picked once
+    FindFunc bestKernel();
+    const char* kernelName();
+
+    inline const char* find(const char* begin, const char* end, std::string_view needle) {
+        return bestKernel()(begin, end, needle.data(), needle.size());
+    }
+
+}
+
+#endif // SIMDSEARCH_H
@@ -0,0 +1,255 @@
+#include "trigramindex.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+inline uint32_t trigramKey(const char* p) {
+    return (uint32_t(uint8_t(p[0])) << 16) | (uint32_t(uint8_t(p[1])) << 8) | uint8_t(p[2]);
+}
+
+inline void putVarint(vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+inline uint32_t getVarint(const uint8_t*& p) {
+    uint32_t value = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        value |= uint32_t(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= uint32_t(*p++) << shift;
+    return value;
+}
+
+void intersect(vector<uint32_t>& a, const vector<uint32_t>& b) {
+    auto end = set_intersection(a.begin(), a.end(), b.begin(), b.end(), a.begin());
+    a.erase(end, a.end());
+}
+
+}
+
+void TrigramIndex::append(PostingList& list, uint32_t id) {
+    // A name can repeat a trigram, keep each id once
+    if (list.count > 0 && list.last == id) return;
+    putVarint(list.bytes, list.count > 0 ? id - list.last : id);
+    list.last = id;
+    ++list.count;
+}
+
+void TrigramIndex::appendList(PostingList& to, const PostingList& from) {
+    if (from.count == 0) return;
+
+    // The first id of a slice is absolute, turn it into a delta against our tail
+    const uint8_t* p = from.bytes.data();
+    uint32_t first = getVarint(p);
+    putVarint(to.bytes, to.count > 0 ? first - to.last : first);
+    to.bytes.insert(to.bytes.end(), p, from.bytes.data() + from.bytes.size());
+    to.last = from.last;
+    to.count += from.count;
+}
+
+void TrigramIndex::decodeBytes(const uint8_t* p, uint32_t count, vector<uint32_t>& out) {
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        id = (i == 0) ? getVarint(p) : id + getVarint(p);
+        out.push_back(id);
+    }
+}
+
+void TrigramIndex::decode(const FrozenList* frozen, const PostingList* live, vector<uint32_t>& out) const {
+    out.clear();
+    out.reserve((frozen ? frozen->count : 0) + (live ? live->count + live->late.size() : 0));
+
+    // Live lists only hold ids added after the snapshot, so they follow the frozen part
+    if (frozen)
+        decodeBytes(frozenBytes + frozen->offset, frozen->count, out);
+    if (!live) return;
+    decodeBytes(live->bytes.data(), live->count, out);
+
+    if (!live->late.empty()) {
+        size_t mid = out.size();
+        out.insert(out.end(), live->late.begin(), live->late.end());
+        inplace_merge(out.begin(), out.begin() + mid, out.end());
+        out.erase(unique(out.begin(), out.end()), out.end());
+    }
+}
+
+const TrigramIndex::FrozenList* TrigramIndex::findFrozen(uint32_t key) const {
+    const FrozenList* end = frozenLists + frozenCount;
+    const FrozenList* it = lower_bound(frozenLists, end, key,
+                                       [](const FrozenList& list, uint32_t value) { return list.key < value; });
+    return (it != end && it->key == key) ? it : nullptr;
+}
+
+void TrigramIndex::indexName(ListMap& map, uint32_t id, string_view foldedName) {
+    for (size_t i = 0; i + 3 <= foldedName.size(); ++i)
+        append(map[trigramKey(foldedName.data() + i)], id);
+}
+
+void TrigramIndex::add(uint32_t id, string_view foldedName) {
+    indexName(lists, id, foldedName);
+    endId = max(endId, id + 1);
+}
+
+void TrigramIndex::addLate(uint32_t id, string_view foldedName) {
+    for (size_t i = 0; i + 3 <= foldedName.size(); ++i) {
+        vector<uint32_t>& late = lists[trigramKey(foldedName.data() + i)].late;
+        auto it = lower_bound(late.begin(), late.end(), id);
+        if (it == late.end() || *it != id)
+            late.insert(it, id);
+    }
+}
+
+void TrigramIndex::build(uint32_t firstId, uint32_t lastId,
+                         const function<string_view(uint32_t)>& foldedNameOf,
+                         unsigned int numThreads) {
+    if (lastId <= firstId) return;
+    numThreads = max(1u, numThreads);
+
+    uint32_t total = lastId - firstId;
+    uint32_t sliceSize = total / numThreads + 1;
+    vector<ListMap> slices(numThreads);
+
+    vector<thread> threads;
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        threads.emplace_back([&, i]() {
+            uint32_t begin = firstId + min(total, i * sliceSize);
+            uint32_t end = firstId + min(total, (i + 1) * sliceSize);
+            for (uint32_t id = begin; id < end; ++id)
+                indexName(slices[i], id, foldedNameOf(id));
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    // Slices cover increasing id ranges, so appending them in order keeps every list sorted
+    for (ListMap& slice : slices) {
+        for (auto& item : slice)
+            appendList(lists[item.first], item.second);
+        ListMap().swap(slice);
+    }
+
+    endId = max(endId, lastId);
+}
+
+void TrigramIndex::append(TrigramIndex&& later) {
+    for (auto& item : later.lists)
+        appendList(lists[item.first], item.second);
+    endId = max(endId, later.endId);
+    later.clear();
+}
+
+bool TrigramIndex::candidates(string_view foldedNeedle, vector<uint32_t>& out) const {
+    out.clear();
+    if (foldedNeedle.size() < 3) return false;
+
+    struct Source {
+        const FrozenList* frozen;
+        const PostingList* live;
+        size_t size;
+        bool operator<(const Source& other) const { return size < other.size; }
+    };
+
+    vector<Source> needed;
+    for (size_t i = 0; i + 3 <= foldedNeedle.size(); ++i) {
+        uint32_t key = trigramKey(foldedNeedle.data() + i);
+        const FrozenList* frozen = findFrozen(key);
+        auto it = lists.find(key);
+        const PostingList* live = it != lists.end() ? &it->second : nullptr;
+        if (!frozen && !live) return true; // some trigram never occurs
+
+        size_t size = (frozen ? frozen->count : 0) + (live ? live->count + live->late.size() : 0);
+        needed.push_back({ frozen, live, size });
+    }
+
+    sort(needed.begin(), needed.end(), [](const Source& a, const Source& b) {
+        return a.frozen != b.frozen ? a.frozen < b.frozen : a.live < b.live;
+    });
+    needed.erase(unique(needed.begin(), needed.end(), [](const Source& a, const Source& b) {
+        return a.frozen == b.frozen && a.live == b.live;
+    }), needed.end());
+    sort(needed.begin(), needed.end());
+
+    decode(needed[0].frozen, needed[0].live, out);
+
+    // Once the set is small the caller's substring check is cheaper than decoding more lists
+    vector<uint32_t> other;
+    for (size_t i = 1; i < needed.size() && out.size() > 64; ++i) {
+        decode(needed[i].frozen, needed[i].live, other);
+        intersect(out, other);
+    }
+    return true;
+}
+
+size_t TrigramIndex::memoryUsage() const {
+    size_t total = lists.size() * (sizeof(PostingList) + sizeof(uint32_t) + 2 * sizeof(void*));
+    for (const auto& item : lists)
+        total += item.second.bytes.capacity() + item.second.late.capacity() * sizeof(uint32_t);
+    return total;
+}
+
+void TrigramIndex::clear() {
+    ListMap().swap(lists);
+    frozenLists = nullptr;
+    frozenCount = 0;
+    frozenBytes = nullptr;
+    endId = 0;
+}
+
+void TrigramIndex::mapFrozen(const FrozenList* directory, size_t count, const uint8_t* bytes, uint32_t frozenEnd) {
+    clear();
+    frozenLists = directory;
+    frozenCount = count;
+    frozenBytes = bytes;
+    endId = frozenEnd;
+}
+
+void TrigramIndex::freeze(vector<FrozenList>& directory, vector<uint8_t>& bytes) const {
+    vector<uint32_t> keys;
+    keys.reserve(frozenCount + lists.size());
+    for (size_t i = 0; i < frozenCount; ++i)
+        keys.push_back(frozenLists[i].key);
+    for (const auto& item : lists)
+        keys.push_back(item.first);
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    directory.clear();
+    directory.reserve(keys.size());
+    bytes.clear();
+
+    vector<uint32_t> ids;
+    for (uint32_t key : keys) {
+        const FrozenList* frozen = findFrozen(key);
+        auto it = lists.find(key);
+        const PostingList* live = it != lists.end() ? &it->second : nullptr;
+
+        FrozenList out = { key, 0, bytes.size(), 0 };
+        if (!live) {
+            // Untouched since the last snapshot, the bytes carry over as they are
+            const uint8_t* p = frozenBytes + frozen->offset;
+            bytes.insert(bytes.end(), p, p + frozen->length);
+            out.count = frozen->count;
+        } else if (!frozen && live->late.empty()) {
+            bytes.insert(bytes.end(), live->bytes.begin(), live->bytes.end());
+            out.count = live->count;
+        } else {
+            // Renames or a frozen head, encode the merged list again
+            decode(frozen, live, ids);
+            for (size_t i = 0; i < ids.size(); ++i)
+                putVarint(bytes, i == 0 ? ids[i] : ids[i] - ids[i - 1]);
+            out.count = uint32_t(ids.size());
+        }
+        out.length = bytes.size() - out.offset;
+        directory.push_back(out);
+    }
+}
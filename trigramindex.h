@@ -0,0 +1,74 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+Posting lists of entry ids for every 3-byte sequence of the case-folded names.
+Ids are stored as varint encoded deltas, so the lists only grow at the end.
+Lists loaded from a snapshot stay frozen in the mapping, ids added afterwards
+go to live lists that are read after them.
+Not thread safe on its own, FileIndex guards it with its lock.
+*/
+class TrigramIndex {
+public:
+    // Indexes a new entry, ids have to be added in increasing order
+    void add(uint32_t id, std::string_view foldedName);
+    // Indexes an entry that is already indexed under another name (renames)
+    void addLate(uint32_t id, std::string_view foldedName);
+    // Indexes ids [firstId, lastId) with one worker per slice, then stitches the lists together
+    void build(uint32_t firstId, uint32_t lastId,
+               const std::function<std::string_view(uint32_t)>& foldedNameOf,
+               unsigned int numThreads);
+    // Takes over the lists of an index built for ids from indexedUpTo() on
+    void append(TrigramIndex&& later);
+
+    // Ascending ids whose names contain every trigram of the needle. False when the needle is too short.
+    bool candidates(std::string_view foldedNeedle, std::vector<uint32_t>& out) const;
+
+    uint32_t indexedUpTo() const { return endId; }
+    size_t memoryUsage() const;
+    void clear();
+
+    // One posting list as stored in a snapshot, the directory is sorted by key
+    struct FrozenList {
+        uint32_t key;
+        uint32_t count;
+        uint64_t offset; // into the snapshot bytes, same encoding as a live list
+        uint64_t length;
+    };
+
+    // Serves ids below endId from snapshot memory, which has to outlive the index or the next clear()
+    void mapFrozen(const FrozenList* directory, size_t count, const uint8_t* bytes, uint32_t endId);
+    // Every list, frozen and live merged, in snapshot layout
+    void freeze(std::vector<FrozenList>& directory, std::vector<uint8_t>& bytes) const;
+
+private:
+    struct PostingList {
+        std::vector<uint8_t> bytes;
+        std::vector<uint32_t> late; // sorted, not delta encoded
+        uint32_t last = 0;
+        uint32_t count = 0;
+    };
+
+    using ListMap = std::unordered_map<uint32_t, PostingList>;
+
+    static void append(PostingList& list, uint32_t id);
+    static void appendList(PostingList& to, const PostingList& from);
+    static void decodeBytes(const uint8_t* p, uint32_t count, std::vector<uint32_t>& out);
+    void decode(const FrozenList* frozen, const PostingList* live, std::vector<uint32_t>& out) const;
+    const FrozenList* findFrozen(uint32_t key) const;
+    static void indexName(ListMap& map, uint32_t id, std::string_view foldedName);
+
+    ListMap lists;
+    const FrozenList* frozenLists = nullptr;
+    size_t frozenCount = 0;
+    const uint8_t* frozenBytes = nullptr;
+    uint32_t endId = 0;
+};
+
+#endif // TRIGRAMINDEX_H
@@ -0,0 +1,148 @@
+#ifndef WORKSTEALING_H
+#define WORKSTEALING_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Runs a directory walk on a fixed set of workers.
+Each worker has its own deque: it pushes the folders it finds to the back and
+takes its next folder from the back too, so it stays deep in one subtree.
+An idle worker steals from the front of another worker's deque, which holds
+the oldest and usually largest subtrees.
+The walk ends when the number of folders pushed but not yet visited drops to zero.
+*/
+template <typename Task>
+class WorkStealingScheduler {
+public:
+    // Called once per task, worker is in [0, workerCount())
+    using Visit = std::function<void(unsigned int worker, Task& task)>;
+
+    explicit WorkStealingScheduler(unsigned int numThreads) {
+        numThreads = std::max(1u, numThreads);
+        for (unsigned int i = 0; i < numThreads; ++i)
+            workers.push_back(std::make_unique<Worker>());
+    }
+
+    // Queues a root before run(), roots are spread over the workers
+    void seed(Task task) {
+        push(nextSeed, std::move(task));
+        nextSeed = (nextSeed + 1) % workerCount();
+    }
+
+    // Queues a task found while visiting, only call from inside visit
+    void push(unsigned int worker, Task task) {
+        // Counted before the task is visible, a thief taking it at once can't drive either below zero
+        pending.fetch_add(1);
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> guard(workers[worker]->lock);
+            workers[worker]->tasks.push_back(std::move(task));
+        }
+
+        // A sleeper counts itself before it checks queued, so one of us sees the other
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> guard(idleLock);
+            idle.notify_one();
+        }
+    }
+
+    // Blocks until every queued task and everything pushed below it was visited
+    void run(const Visit& visit) {
+        if (pending.load() == 0) return;
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < workerCount(); ++i)
+            threads.emplace_back([this, i, &visit]() { workerLoop(i, visit); });
+        workerLoop(0, visit);
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    unsigned int workerCount() const { return unsigned(workers.size()); }
+    size_t stealCount() const { return steals.load(); }
+    // Folders waiting in some deque right now
+    size_t queuedCount() const { return queued.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool takeOwn(unsigned int worker, Task& task) {
+        Worker& own = *workers[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.tasks.empty()) return false;
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(unsigned int worker, Task& task) {
+        unsigned int count = workerCount();
+        for (unsigned int i = 1; i < count; ++i) {
+            Worker& victim = *workers[(worker + i) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            steals.fetch_add(1);
+            return true;
+        }
+        return false;
+    }
+
+    // Sleeps until something is queued or the walk is over, false means over
+    bool waitForWork() {
+        std::unique_lock<std::mutex> guard(idleLock);
+        sleepers.fetch_add(1);
+        idle.wait(guard, [this] { return pending.load() == 0 || queued.load() > 0; });
+        sleepers.fetch_sub(1);
+        return pending.load() != 0;
+    }
+
+    void finished() {
+        // Children were pushed before this, so zero really means nothing is left
+        if (pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> guard(idleLock);
+            idle.notify_all();
+        }
+    }
+
+    void workerLoop(unsigned int worker, const Visit& visit) {
+        Task task;
+        while (true) {
+            if (takeOwn(worker, task) || steal(worker, task)) {
+                visit(worker, task);
+                task = Task();
+                finished();
+                continue;
+            }
+            if (!waitForWork()) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> pending{0};  // pushed and not visited yet
+    std::atomic<size_t> queued{0};   // sitting in some deque
+    std::atomic<size_t> sleepers{0};
+    std::atomic<size_t> steals{0};
+    unsigned int nextSeed = 0;
+
+    std::mutex idleLock;
+    std::condition_variable idle;
+};
+
+#endif // WORKSTEALING_H